@@ -0,0 +1,707 @@
+/** ============================================================================
+ *
+ * MCL Text Editor benchmarks
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+/*
+	A headless benchmark suite for the editor core.
+
+	Usage: Benchmarks [--lines 1000,10000,100000,1000000] [--file path]... [--output results.json] [--quick]
+
+	Every benchmark runs on the synthetic corpora (one per line count) and on every file that is
+	passed with --file. The results are written as JSON (to stdout if no output file is given)
+	with the time per operation, the number of heap allocations per operation and the peak RSS
+	of the process so that you can diff them between versions.
+*/
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <atomic>
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+ #include <psapi.h>
+ #pragma comment (lib, "psapi.lib")
+#else
+ #include <sys/resource.h>
+#endif
+
+//==============================================================================
+/*	Counts the heap allocations of the process.
+
+	On Linux malloc / calloc / realloc are interposed, which catches the allocations of JUCE's
+	HeapBlock (Array, OwnedArray etc.) as well as operator new. On the other platforms only the
+	global operator new is replaced, so containers that use std::malloc directly are not counted.
+*/
+static std::atomic<juce::int64> numHeapAllocations { 0 };
+
+#if JUCE_LINUX
+
+extern "C"
+{
+	void* __libc_malloc(size_t);
+	void* __libc_calloc(size_t, size_t);
+	void* __libc_realloc(void*, size_t);
+
+	void* malloc(size_t size)
+	{
+		numHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+		return __libc_malloc(size);
+	}
+
+	void* calloc(size_t num, size_t size)
+	{
+		numHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+		return __libc_calloc(num, size);
+	}
+
+	void* realloc(void* p, size_t size)
+	{
+		numHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+		return __libc_realloc(p, size);
+	}
+}
+
+static const char* allocationCounterType = "malloc";
+
+#else
+
+void* operator new(size_t size)
+{
+	numHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (auto p = std::malloc(size > 0 ? size : 1))
+		return p;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+static const char* allocationCounterType = "operator new";
+
+#endif
+
+static juce::int64 getPeakResidentSetSize()
+{
+#if JUCE_WINDOWS
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return (juce::int64)counters.PeakWorkingSetSize;
+
+	return 0;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+   #if JUCE_MAC
+	return (juce::int64)usage.ru_maxrss;
+   #else
+	return (juce::int64)usage.ru_maxrss * 1024;
+   #endif
+#endif
+}
+
+namespace mcl
+{
+using namespace juce;
+
+//==============================================================================
+/** A text corpus with its CodeDocument and TextDocument. */
+struct Corpus
+{
+	Corpus(const String& name_, const String& text_) :
+		name(name_),
+		text(text_),
+		document(codeDocument)
+	{
+		codeDocument.replaceAllContent(text);
+
+		document.setFont(Font(Font::getDefaultMonospacedFontName(), 16.0f, Font::plain));
+		document.replaceAll(text);
+
+		numBytes = (int64)text.getNumBytesAsUTF8();
+		numLines = codeDocument.getNumLines();
+	}
+
+	/** Creates a deterministic C++ like text with the given number of lines. */
+	static String createSynthetic(int numLinesToCreate)
+	{
+		Random r(numLinesToCreate);
+		String s;
+		s.preallocateBytes((size_t)numLinesToCreate * 40);
+
+		int level = 0;
+
+		for (int i = 0; i < numLinesToCreate; i++)
+		{
+			String line;
+
+			for (int t = 0; t < level; t++)
+				line << "\t";
+
+			auto remaining = numLinesToCreate - i;
+
+			if (level > 0 && (remaining <= level || r.nextInt(6) == 0))
+			{
+				line = line.dropLastCharacters(1) + "}";
+				level--;
+			}
+			else
+			{
+				switch (r.nextInt(8))
+				{
+				case 0:  line << "// Comment number " << i << " with some text: \xc3\xa4\xc3\xb6\xc3\xbc"; break;
+				case 1:  line << "void function" << i << "(int argument, float* buffer)"; break;
+				case 2:  line << "{"; level = jmin(level + 1, 12); break;
+				case 3:  line << "auto value" << i << " = 0x" << String::toHexString(r.nextInt()) << " + " << r.nextFloat() << ";"; break;
+				case 4:  line << "DBG(\"String literal " << i << "\");"; break;
+				case 5:  line << "if (value > " << r.nextInt(1000) << ") return;"; break;
+				case 6:  break;
+				default: line << "SomeClass::someMethod(value, " << i << ", nullptr);"; break;
+				}
+			}
+
+			s << line;
+
+			if (i != numLinesToCreate - 1)
+				s << "\n";
+		}
+
+		return s;
+	}
+
+	String name;
+	String text;
+	int64 numBytes = 0;
+	int numLines = 0;
+
+	CodeDocument codeDocument;
+	TextDocument document;
+};
+
+//==============================================================================
+class BenchmarkRunner
+{
+public:
+
+	BenchmarkRunner(bool quickMode_) :
+		quickMode(quickMode_)
+	{}
+
+	void runAll(Corpus& c)
+	{
+		std::cerr << "Running benchmarks for " << c.name << " (" << c.numLines << " lines)" << std::endl;
+
+		benchmarkTextDocument(c);
+		benchmarkGlyphArrangementArray(c);
+		benchmarkScrolling(c);
+		benchmarkTokeniser(c);
+		benchmarkFoldRanges(c);
+		benchmarkSearch(c);
+		benchmarkTokenCollection(c);
+		benchmarkCodeMap(c);
+		benchmarkMinimapKernel(c);
+		benchmarkLineScanner(c);
+	}
+
+	var toJSON() const
+	{
+		DynamicObject::Ptr root = new DynamicObject();
+
+		root->setProperty("module", "mcl_editor");
+		root->setProperty("time", Time::getCurrentTime().toISO8601(true));
+		root->setProperty("cpu", SystemStats::getCpuModel());
+		root->setProperty("operating_system", SystemStats::getOperatingSystemName());
+		root->setProperty("simd", MCL_SIMD_SSE2 ? "sse2" : (MCL_SIMD_NEON ? "neon" : "none"));
+		root->setProperty("line_scanner", LineScanner::getInstructionSet());
+		root->setProperty("allocation_counter", allocationCounterType);
+		root->setProperty("peak_rss_bytes", getPeakResidentSetSize());
+		root->setProperty("results", results);
+
+		return var(root.get());
+	}
+
+private:
+
+	struct Options
+	{
+		int64 bytesPerOperation = 0;
+		int maxIterations = 1000;
+		double minimumSeconds = 0.25;
+	};
+
+	template <typename F> void measure(const String& name, const Corpus& c, const Options& o, F&& f)
+	{
+		auto minimumSeconds = quickMode ? 0.0 : o.minimumSeconds;
+		auto maxIterations = quickMode ? 1 : o.maxIterations;
+
+		auto allocationsBefore = numHeapAllocations.load();
+		auto start = Time::getHighResolutionTicks();
+
+		int numIterations = 0;
+		double elapsed = 0.0;
+
+		do
+		{
+			f();
+			numIterations++;
+			elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+		}
+		while (numIterations < maxIterations && elapsed < minimumSeconds);
+
+		auto numAllocations = numHeapAllocations.load() - allocationsBefore;
+
+		DynamicObject::Ptr r = new DynamicObject();
+
+		r->setProperty("name", name);
+		r->setProperty("corpus", c.name);
+		r->setProperty("lines", c.numLines);
+		r->setProperty("bytes", c.numBytes);
+		r->setProperty("iterations", numIterations);
+		r->setProperty("ns_per_op", elapsed * 1.0e9 / (double)numIterations);
+		r->setProperty("allocations_per_op", (double)numAllocations / (double)numIterations);
+
+		if (o.bytesPerOperation > 0)
+		{
+			auto bytesPerSecond = (double)o.bytesPerOperation * (double)numIterations / elapsed;
+			r->setProperty("mb_per_second", bytesPerSecond / (1024.0 * 1024.0));
+			r->setProperty("gb_per_second", bytesPerSecond / (1024.0 * 1024.0 * 1024.0));
+		}
+
+		results.append(var(r.get()));
+	}
+
+	void skip(const String& name, const Corpus& c, const String& reason)
+	{
+		DynamicObject::Ptr r = new DynamicObject();
+
+		r->setProperty("name", name);
+		r->setProperty("corpus", c.name);
+		r->setProperty("lines", c.numLines);
+		r->setProperty("skipped", reason);
+
+		results.append(var(r.get()));
+	}
+
+	void benchmarkTextDocument(Corpus& c)
+	{
+		Options o;
+		o.bytesPerOperation = c.numBytes;
+		o.maxIterations = 20;
+
+		measure("TextDocument::replaceAll", c, o, [&c]()
+		{
+			c.document.replaceAll(c.text);
+		});
+
+		o.bytesPerOperation = 0;
+		o.maxIterations = 100000;
+
+		Random r(1);
+
+		measure("TextDocument::getCharacter", c, o, [&c, &r]()
+		{
+			auto row = r.nextInt(c.numLines);
+			auto numColumns = jmax(1, c.document.getNumColumns(row));
+			c.document.getCharacter({ row, r.nextInt(numColumns) });
+		});
+	}
+
+	void benchmarkGlyphArrangementArray(Corpus& c)
+	{
+		Options o;
+		o.bytesPerOperation = c.numBytes;
+		o.maxIterations = 5;
+
+		measure("GlyphArrangementArray::layout", c, o, [&c]()
+		{
+			c.document.invalidate({});
+		});
+
+		o.bytesPerOperation = 0;
+		o.maxIterations = 10000;
+
+		Random r(2);
+
+		measure("TextDocument::getGlyphsForRow", c, o, [&c, &r]()
+		{
+			c.document.getGlyphsForRow(r.nextInt(c.numLines), -1, true);
+		});
+
+		measure("TextDocument::findIndexNearestPosition", c, o, [&c, &r]()
+		{
+			auto b = c.document.getBounds();
+			c.document.findIndexNearestPosition({ r.nextFloat() * b.getWidth(), r.nextFloat() * b.getHeight() });
+		});
+	}
+
+	void benchmarkScrolling(Corpus& c)
+	{
+		// A viewport that moves down a few rows per frame and collects the glyphs to draw (the
+		// rasterisation is JUCE's business and not measured). The first pass creates the layouts
+		// of the rows that come into view, the measured second pass is the steady state that
+		// should not allocate anything.
+		static constexpr int NumVisibleRows = 60;
+		static constexpr int RowsPerFrame = 3;
+		static constexpr int NumFrames = 500;
+		static constexpr int NumTokens = 8;
+
+		FrameArena arena;
+
+		auto rowHeight = c.document.getRowHeight();
+		auto numRowsToScroll = jmax(1, c.numLines - NumVisibleRows);
+		auto width = c.document.getBounds().getWidth();
+		int frame = 0;
+
+		auto renderFrame = [&]()
+		{
+			auto firstRow = (frame++ * RowsPerFrame) % numRowsToScroll;
+			Rectangle<float> area(0.0f, (float)firstRow * rowHeight, width, (float)NumVisibleRows * rowHeight);
+
+			arena.reset();
+			c.document.collectGlyphsIntersecting(area, NumTokens, arena);
+			c.document.getLayoutHash({ firstRow, firstRow + NumVisibleRows });
+		};
+
+		for (int i = 0; i < NumFrames; i++)
+			renderFrame();
+
+		frame = 0;
+
+		Options o;
+		o.maxIterations = NumFrames;
+		o.minimumSeconds = 60.0;
+
+		measure("TextDocument::collectGlyphsIntersecting (scrolling)", c, o, renderFrame);
+	}
+
+	void benchmarkTokeniser(Corpus& c)
+	{
+		Options o;
+		o.bytesPerOperation = c.numBytes;
+		o.maxIterations = 5;
+
+		measure("CppTokeniserFunctions::readNextToken", c, o, [&c]()
+		{
+			TextDocument::Iterator it(c.document, { 0, 0 });
+			auto previous = it.getIndex();
+			Array<Selection> zones;
+
+			while (!it.isEOF())
+			{
+				auto tokenType = CppTokeniserFunctions::readNextToken(it);
+				zones.add(Selection(previous, it.getIndex()).withStyle(tokenType));
+				previous = it.getIndex();
+			}
+		});
+	}
+
+	void benchmarkFoldRanges(Corpus& c)
+	{
+		// The range list is built from the braces. setRanges() is quadratic in the number of ranges,
+		// so it's capped to keep the large corpora in a sensible time frame
+		static constexpr int MaxNumRanges = 5000;
+
+		Array<Range<int>> ranges;
+		Array<int> openLines;
+
+		for (int i = 0; i < c.numLines && ranges.size() < MaxNumRanges; i++)
+		{
+			auto line = c.document.getLine(i);
+
+			if (line.containsChar('{'))
+				openLines.add(i);
+			else if (line.containsChar('}') && !openLines.isEmpty())
+				ranges.add({ openLines.removeAndReturn(openLines.size() - 1), i + 1 });
+		}
+
+		Options o;
+		o.maxIterations = 10;
+
+		auto& holder = c.document.getFoldableLineRangeHolder();
+
+		measure("FoldableLineRange::Holder::setRanges", c, o, [&holder, &ranges]()
+		{
+			holder.setRanges(ranges);
+		});
+
+		o.maxIterations = 5;
+
+		measure("FoldableLineRange::Holder::getLineType", c, o, [&holder, &c]()
+		{
+			for (int i = 0; i < c.numLines; i++)
+				holder.getLineType(i);
+		});
+
+		holder.setRanges({});
+	}
+
+	void benchmarkSearch(Corpus& c)
+	{
+		Options o;
+		o.bytesPerOperation = c.numBytes;
+		o.maxIterations = 5;
+
+		measure("TextDocument::search", c, o, [&c]()
+		{
+			Point<int> start;
+			String target("someMethod");
+
+			while (start != c.document.getEnd())
+			{
+				auto s = c.document.search(start, target);
+
+				if (s.isSingular())
+					break;
+
+				start = s.tail;
+			}
+		});
+	}
+
+	void benchmarkTokenCollection(Corpus& c)
+	{
+		static constexpr int MaxNumLines = 100000;
+
+		if (c.numLines > MaxNumLines)
+		{
+			skip("TokenCollection::rebuild", c, "the token provider is quadratic in the number of tokens");
+			return;
+		}
+
+		TokenCollection collection;
+		collection.addTokenProvider(new SimpleDocumentTokenProvider(c.codeDocument));
+
+		// run the rebuild synchronously
+		collection.stopThread(1000);
+
+		Options o;
+		o.bytesPerOperation = c.numBytes;
+		o.maxIterations = 5;
+
+		measure("TokenCollection::rebuild", c, o, [&collection]()
+		{
+			collection.signalRebuild();
+			collection.rebuild();
+		});
+
+		o.bytesPerOperation = 0;
+		o.maxIterations = 10000;
+
+		measure("TokenCollection::hasEntries", c, o, [&collection]()
+		{
+			collection.hasEntries("func", "", 0);
+		});
+	}
+
+	void benchmarkCodeMap(Corpus& c)
+	{
+		CodeMap map(c.document, new CPlusPlusCodeTokeniser());
+
+		if (!map.isActive())
+		{
+			skip("CodeMap::rebuild", c, "the code map is disabled for documents with more than 10000 lines");
+			return;
+		}
+
+		map.colourScheme = CPlusPlusCodeTokeniser().getDefaultColourScheme();
+		map.setSize(150, 1000);
+
+		Options o;
+		o.bytesPerOperation = c.numBytes;
+		o.maxIterations = 20;
+
+		measure("CodeMap::rebuild", c, o, [&map]()
+		{
+			map.rebuild();
+		});
+	}
+
+	void benchmarkMinimapKernel(Corpus& c)
+	{
+		StringArray lines;
+		Array<MinimapKernel::TokenRun> runs;
+		MinimapKernel::Row row;
+
+		for (int i = 0; i < c.numLines; i++)
+			lines.add(c.codeDocument.getLine(i));
+
+		runs.add({ 0, 8, 1 });
+		runs.add({ 8, std::numeric_limits<int>::max(), 2 });
+
+		Options o;
+		o.bytesPerOperation = c.numBytes;
+		o.maxIterations = 20;
+
+		measure("MinimapKernel::process", c, o, [&]()
+		{
+			for (const auto& l : lines)
+			{
+				auto utf8 = l.toRawUTF8();
+				MinimapKernel::process(utf8, (int)std::strlen(utf8), runs.begin(), runs.size(), row);
+			}
+		});
+
+		measure("MinimapKernel::processPerCharacter", c, o, [&]()
+		{
+			for (const auto& l : lines)
+			{
+				auto utf8 = l.toRawUTF8();
+				MinimapKernel::processPerCharacter(utf8, (int)std::strlen(utf8), runs.begin(), runs.size(), row);
+			}
+		});
+	}
+
+	/** Compares the line scanner with the per character loops that it replaces. */
+	void benchmarkLineScanner(Corpus& c)
+	{
+		auto utf8 = c.text.toRawUTF8();
+		auto numBytes = (int)c.numBytes;
+
+		Options o;
+		o.bytesPerOperation = c.numBytes;
+		o.maxIterations = 100;
+
+		LineScanner scanner;
+
+		measure("LineScanner::scan", c, o, [&]()
+		{
+			scanner.scan(utf8, numBytes);
+		});
+
+		measure("LineScanner::scanPerCharacter", c, o, [&]()
+		{
+			scanner.scanPerCharacter(utf8, numBytes);
+		});
+
+		measure("StringArray::fromLines", c, o, [&c]()
+		{
+			auto lines = StringArray::fromLines(c.text);
+			ignoreUnused(lines);
+		});
+
+		measure("CodeDocument::Iterator", c, o, [&c]()
+		{
+			CodeDocument::Iterator it(c.codeDocument);
+			int maximumLineLength = 0;
+			int lineLength = 0;
+
+			while (!it.isEOF())
+			{
+				auto ch = it.nextChar();
+				lineLength = ch == '\n' ? 0 : lineLength + 1;
+				maximumLineLength = jmax(maximumLineLength, lineLength);
+			}
+
+			ignoreUnused(maximumLineLength);
+		});
+
+		measure("LineScanner::skipLines", c, o, [&]()
+		{
+			auto p = utf8;
+			LineScanner::skipLines(p, utf8 + numBytes, std::numeric_limits<int>::max());
+		});
+	}
+
+	const bool quickMode;
+	Array<var> results;
+};
+
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+	using namespace juce;
+
+	ScopedJuceInitialiser_GUI juceInitialiser;
+
+	Array<int> lineCounts = { 1000, 10000, 100000, 1000000 };
+	StringArray files;
+	File outputFile;
+	bool quickMode = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		String arg(argv[i]);
+
+		if (arg == "--lines" && i + 1 < argc)
+		{
+			lineCounts.clear();
+
+			for (auto s : StringArray::fromTokens(argv[++i], ",", ""))
+				lineCounts.add(s.getIntValue());
+		}
+		else if (arg == "--file" && i + 1 < argc)
+			files.add(argv[++i]);
+		else if (arg == "--output" && i + 1 < argc)
+			outputFile = File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+		else if (arg == "--quick")
+			quickMode = true;
+		else if (arg == "--test")
+		{
+			UnitTestRunner tests;
+			tests.runTestsInCategory("mcl");
+
+			for (int t = 0; t < tests.getNumResults(); t++)
+			{
+				if (tests.getResult(t)->failures > 0)
+					return 1;
+			}
+
+			return 0;
+		}
+		else
+		{
+			std::cerr << "Usage: Benchmarks [--lines 1000,10000] [--file path]... [--output results.json] [--quick] [--test]" << std::endl;
+			return 1;
+		}
+	}
+
+	mcl::BenchmarkRunner runner(quickMode);
+
+	for (auto numLines : lineCounts)
+	{
+		mcl::Corpus c("synthetic-" + String(numLines), mcl::Corpus::createSynthetic(numLines));
+		runner.runAll(c);
+	}
+
+	for (auto f : files)
+	{
+		File file = File::getCurrentWorkingDirectory().getChildFile(f);
+
+		if (!file.existsAsFile())
+		{
+			std::cerr << "Can't find " << file.getFullPathName() << std::endl;
+			return 1;
+		}
+
+		mcl::Corpus c(file.getFileName(), file.loadFileAsString());
+		runner.runAll(c);
+	}
+
+	auto json = JSON::toString(runner.toJSON());
+
+	if (outputFile != File())
+		outputFile.replaceWithText(json);
+	else
+		std::cout << json << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+mcl::FrameArena::FrameArena(size_t initialSize)
+{
+	addBlock(initialSize);
+}
+
+void mcl::FrameArena::reset()
+{
+	if (blocks.size() > 1)
+	{
+		size_t totalSize = 0;
+
+		for (auto b : blocks)
+			totalSize += b->size;
+
+		blocks.clear();
+		addBlock(totalSize);
+	}
+
+	position = 0;
+	numBytesUsed = 0;
+}
+
+void* mcl::FrameArena::allocateBytes(size_t numBytes, size_t alignment)
+{
+	jassert(isPowerOfTwo(alignment));
+
+	auto b = blocks.getLast();
+	auto start = (position + alignment - 1) & ~(alignment - 1);
+
+	if (start + numBytes > b->size)
+	{
+		addBlock(numBytes + alignment);
+		b = blocks.getLast();
+		start = 0;
+	}
+
+	position = start + numBytes;
+	numBytesUsed += numBytes;
+
+	return b->data.get() + start;
+}
+
+juce::int64 mcl::FrameArena::getNumBytes() const
+{
+	int64 numBytes = 0;
+
+	for (auto b : blocks)
+		numBytes += (int64)b->size;
+
+	return numBytes;
+}
+
+void mcl::FrameArena::addBlock(size_t minSize)
+{
+	auto size = blocks.isEmpty() ? minSize : jmax(minSize, blocks.getLast()->size * 2);
+	blocks.add(new Block(jmax(size, (size_t)64)));
+	position = 0;
+}
+
+//==============================================================================
+void* mcl::SlabPool::allocate(size_t numBytes)
+{
+	auto c = getSizeClass(numBytes);
+
+	if (c == nullptr)
+		return ::operator new(numBytes);
+
+	auto objectSize = (numBytes + Granularity - 1) / Granularity * Granularity;
+
+	SizeClass::ScopedLock sl(*c);
+
+	if (auto f = c->freeList)
+	{
+		c->freeList = f->next;
+		return f;
+	}
+
+	if (c->slabPosition == nullptr || c->slabPosition + objectSize > c->slabEnd)
+	{
+		c->slabPosition = static_cast<char*>(::operator new(SlabSize));
+		c->slabEnd = c->slabPosition + SlabSize;
+		c->numSlabs++;
+	}
+
+	auto p = c->slabPosition;
+	c->slabPosition += objectSize;
+	return p;
+}
+
+void mcl::SlabPool::deallocate(void* p, size_t numBytes)
+{
+	if (p == nullptr)
+		return;
+
+	auto c = getSizeClass(numBytes);
+
+	if (c == nullptr)
+	{
+		::operator delete(p);
+		return;
+	}
+
+	SizeClass::ScopedLock sl(*c);
+
+	auto f = static_cast<FreeObject*>(p);
+	f->next = c->freeList;
+	c->freeList = f;
+}
+
+juce::int64 mcl::SlabPool::getNumBytes()
+{
+	int64 numBytes = 0;
+
+	for (size_t s = Granularity; s <= MaxObjectSize; s += Granularity)
+	{
+		auto c = getSizeClass(s);
+		SizeClass::ScopedLock sl(*c);
+		numBytes += c->numSlabs * (int64)SlabSize;
+	}
+
+	return numBytes;
+}
+
+mcl::SlabPool::SizeClass* mcl::SlabPool::getSizeClass(size_t numBytes)
+{
+	static_assert(std::is_trivially_destructible<SizeClass>::value, "must be trivially destructible");
+
+	// zero initialised before any dynamic initialisation
+	static SizeClass sizeClasses[MaxObjectSize / Granularity];
+
+	if (numBytes == 0 || numBytes > MaxObjectSize)
+		return nullptr;
+
+	return sizeClasses + (numBytes - 1) / Granularity;
+}
+
+
+}
@@ -0,0 +1,136 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+/**
+	A bump allocator for the transient data of a single render pass.
+
+	The memory is handed out from a block without any bookkeeping and everything
+	is released at once with reset(). If a pass needs more than the current block,
+	another block is added and the next reset() replaces all blocks with a single
+	one of the combined size, so after a few frames the arena stops allocating.
+
+	Only use this for trivially destructible types, the destructors are never called.
+*/
+class FrameArena
+{
+public:
+
+	static constexpr size_t DefaultBlockSize = 64 * 1024;
+
+	FrameArena(size_t initialSize = DefaultBlockSize);
+
+	/** Releases all allocations since the last reset. */
+	void reset();
+
+	/** Allocates the given number of value initialised elements. */
+	template <typename T> T* allocate(int numElements)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "the destructor will not be called");
+
+		auto p = static_cast<T*>(allocateBytes(sizeof(T) * (size_t)jmax(0, numElements), alignof(T)));
+
+		for (int i = 0; i < numElements; i++)
+			new (p + i) T();
+
+		return p;
+	}
+
+	void* allocateBytes(size_t numBytes, size_t alignment);
+
+	/** Returns the size of all blocks. */
+	int64 getNumBytes() const;
+
+	/** Returns the number of bytes that were allocated since the last reset. */
+	size_t getNumBytesUsed() const { return numBytesUsed; }
+
+private:
+
+	struct Block
+	{
+		Block(size_t size_) : data(size_), size(size_) {}
+
+		HeapBlock<char> data;
+		const size_t size;
+	};
+
+	void addBlock(size_t minSize);
+
+	OwnedArray<Block> blocks;
+	size_t position = 0;
+	size_t numBytesUsed = 0;
+
+	JUCE_DECLARE_NON_COPYABLE(FrameArena);
+};
+
+
+//==============================================================================
+/**
+	A process wide allocator for small objects with a free list per size class.
+
+	The objects are carved out of SlabSize blocks, so creating and removing lines
+	(and their layouts and undo steps) reuses the memory of the deleted objects
+	instead of going to the heap every time. The slabs are never released, so the
+	pool keeps the peak number of objects.
+
+	This is used by the MemoryUsage::Tracked objects, larger objects are passed
+	on to the global operator new.
+*/
+struct SlabPool
+{
+	static constexpr size_t Granularity = 16;
+	static constexpr size_t MaxObjectSize = 512;
+	static constexpr size_t SlabSize = 64 * 1024;
+
+	static void* allocate(size_t numBytes);
+	static void deallocate(void* p, size_t numBytes);
+
+	/** Returns the size of all slabs. */
+	static int64 getNumBytes();
+
+private:
+
+	struct FreeObject
+	{
+		FreeObject* next;
+	};
+
+	/** This is trivially destructible so that objects can be deleted during the static destruction. */
+	struct SizeClass
+	{
+		struct ScopedLock
+		{
+			ScopedLock(SizeClass& c_) : c(c_) { while (c.lock.test_and_set(std::memory_order_acquire)) {} }
+			~ScopedLock() { c.lock.clear(std::memory_order_release); }
+
+			SizeClass& c;
+		};
+
+		std::atomic_flag lock;
+		FreeObject* freeList;
+		char* slabPosition;
+		char* slabEnd;
+		int64 numSlabs;
+	};
+
+	static SizeClass* getSizeClass(size_t numBytes);
+};
+
+
+}
@@ -35,7 +35,8 @@ public:
 
 	/** A Token is the entry that is being used in the autocomplete popup (or any other IDE tools
 	    that might use that database. */
-	struct Token: public ReferenceCountedObject
+	struct Token: public ReferenceCountedObject,
+				  public MemoryUsage::Tracked<MemoryUsage::Autocomplete>
 	{
 		Token(const String& text) :
 			tokenContent(text)
@@ -169,6 +170,16 @@ public:
 		stopThread(1000);
 	}
 
+	void addMemoryUsage(MemoryUsage& m) const
+	{
+		for (auto t : tokens)
+		{
+			m.add(MemoryUsage::Autocomplete, (int64)(sizeof(Token) + sizeof(Token*)) +
+											 MemoryUsage::getStringBytes(t->tokenContent) +
+											 MemoryUsage::getStringBytes(t->markdownDescription));
+		}
+	}
+
 	bool hasEntries(const String& input, const String& previousToken, int lineNumber) const
 	{
 		for (auto t : tokens)
@@ -262,50 +273,113 @@ private:
 	JUCE_DECLARE_WEAK_REFERENCEABLE(TokenCollection);
 };
 
-/** A TokenCollection::Provider subclass that scans the current document and creates a list of all tokens. */
+/** A TokenCollection::Provider subclass that scans the current document and creates a list of all tokens.
+
+	The lines are taken from the line entries of the TextDocument, so the text doesn't have to be
+	copied and scanned for the line breaks again. The entries are collected on the message thread
+	after the document was changed and scanned for the identifiers on the rebuild thread.
+*/
 struct SimpleDocumentTokenProvider : public TokenCollection::Provider,
-									 public CoallescatedCodeDocumentListener
+									 public CoallescatedCodeDocumentListener,
+									 private AsyncUpdater
 {
-	SimpleDocumentTokenProvider(CodeDocument& doc) :
-		CoallescatedCodeDocumentListener(doc)
-	{}
+	SimpleDocumentTokenProvider(TextDocument& doc) :
+		CoallescatedCodeDocumentListener(doc.getCodeDocument()),
+		document(doc)
+	{
+		lines = document.getLineEntries();
+	}
+
+	~SimpleDocumentTokenProvider()
+	{
+		cancelPendingUpdate();
+	}
 
 	void codeChanged(bool, int, int) override
 	{
-		signalRebuild();
+		// The TextDocument might not have updated its lines yet
+		triggerAsyncUpdate();
 	}
 
 	void addTokens(TokenCollection::List& tokens) override
 	{
-		CodeDocument::Iterator it(lambdaDoc);
-		String currentString;
+		ReferenceCountedArray<GlyphArrangementArray::Entry> linesToScan;
+
+		{
+			ScopedLock sl(lock);
+			linesToScan = lines;
+		}
 
-		while (!it.isEOF())
+		for (auto l : linesToScan)
 		{
-			auto c = it.nextChar();
+			auto utf8 = l->string.toRawUTF8();
 
-			if (CharacterFunctions::isLetter(c) || (c == '_') || (currentString.isNotEmpty() && CharacterFunctions::isLetterOrDigit(c)))
-				currentString << c;
+			// ASCII lines don't need to be decoded
+			if (l->isASCII)
+				addIdentifiers(CharPointer_ASCII(utf8), utf8 + l->length, tokens);
 			else
+				addIdentifiers(CharPointer_UTF8(utf8), utf8 + l->string.getNumBytesAsUTF8(), tokens);
+		}
+	}
+
+private:
+
+	void handleAsyncUpdate() override
+	{
+		auto newLines = document.getLineEntries();
+
+		{
+			ScopedLock sl(lock);
+			lines.swapWith(newLines);
+		}
+
+		signalRebuild();
+	}
+
+	TextDocument& document;
+
+	CriticalSection lock;
+	ReferenceCountedArray<GlyphArrangementArray::Entry> lines;
+
+	template <typename CharPointerType> static void addIdentifiers(CharPointerType p, const char* end, TokenCollection::List& tokens)
+	{
+		while (p.getAddress() < end)
+		{
+			auto start = p;
+			auto c = p.getAndAdvance();
+
+			if (!(CharacterFunctions::isLetter(c) || c == '_'))
+				continue;
+
+			auto identifierEnd = p;
+
+			// this skips the character after the identifier, which can't start another one
+			while (p.getAddress() < end)
 			{
-				if (currentString.length() > 2)
-				{
-					bool found = false;
+				c = p.getAndAdvance();
+
+				if (!(CharacterFunctions::isLetterOrDigit(c) || c == '_'))
+					break;
+
+				identifierEnd = p;
+			}
 
-					for (auto& t : tokens)
+			if (start.lengthUpTo(identifierEnd) > 2)
+			{
+				String currentString(CharPointer_UTF8(start.getAddress()), CharPointer_UTF8(identifierEnd.getAddress()));
+				bool found = false;
+
+				for (auto& t : tokens)
+				{
+					if (t->tokenContent == currentString)
 					{
-						if (t->tokenContent == currentString)
-						{
-							found = true;
-							break;
-						}
+						found = true;
+						break;
 					}
-
-					if(!found)
-						tokens.add(new TokenCollection::Token(currentString));
 				}
-					
-				currentString = {};
+
+				if(!found)
+					tokens.add(new TokenCollection::Token(currentString));
 			}
 		}
 	}
@@ -20,78 +20,224 @@ using namespace juce;
 mcl::CaretComponent::CaretComponent(const TextDocument& document) : document(document)
 {
 	setInterceptsMouseClicks(false, false);
-	startTimerHz(20);
 }
 
 void mcl::CaretComponent::setViewTransform(const AffineTransform& transformToUse)
 {
 	transform = transformToUse;
-	repaint();
+	repaintCaretAreas();
 }
 
 void mcl::CaretComponent::updateSelections()
 {
-	phase = 0.f;
-	repaint();
+	blinkStart = Time::getMillisecondCounterHiRes();
+	lastAlphaStep = -1;
+	repaintCaretAreas();
+
+	// the phase was restarted, so the next fade has moved
+	if (shouldBlink)
+		updateBlinkState();
 }
 
-void mcl::CaretComponent::paint(Graphics& g)
+void mcl::CaretComponent::startBlinking()
 {
-#if PROFILE_PAINTS
-	auto start = Time::getMillisecondCounterHiRes();
+	repaintCaretAreas();
+
+#if ENABLE_CARET_BLINK
+	shouldBlink = true;
+	blinkStart = Time::getMillisecondCounterHiRes();
+	lastAlphaStep = -1;
+	updateBlinkState();
 #endif
+}
+
+void mcl::CaretComponent::stopBlinking()
+{
+	shouldBlink = false;
+	suspendBlinkUpdates();
+	repaintCaretAreas();
+}
+
+void mcl::CaretComponent::paint(Graphics& g)
+{
+	Profiler::ScopedTimer st(Profiler::Caret);
 
 	auto colour = getParentComponent()->findColour(juce::CaretComponent::caretColourId);
-	auto outline = colour.contrasting();
 
 	UnblurryGraphics ug(g, *this);
 
 	bool drawCaretLine = document.getNumSelections() == 1 && document.getSelections().getFirst().isSingular();
 
-	
+	auto alpha = shouldBlink ? getAlpha(Time::getMillisecondCounterHiRes() - blinkStart) : 0.6f;
 
 	for (const auto &r : getCaretRectangles())
 	{
-		g.setColour(colour.withAlpha(squareWave(phase)));
+		g.setColour(colour.withAlpha(alpha));
 
 		auto rf = ug.getRectangleWithFixedPixelWidth(r, 2);
 		g.fillRect(rf);
 
-
-
 		if (drawCaretLine)
 		{
 			g.setColour(Colours::white.withAlpha(0.04f));
 			g.fillRect(r.withX(0.0f).withWidth(getWidth()));
 		}
 	}
+}
 
-#if PROFILE_PAINTS
-	std::cout << "[CaretComponent::paint] " << Time::getMillisecondCounterHiRes() - start << std::endl;
-#endif
+void mcl::CaretComponent::visibilityChanged()
+{
+	if (shouldBlink)
+		updateBlinkState();
+}
+
+void mcl::CaretComponent::parentHierarchyChanged()
+{
+	if (shouldBlink)
+		updateBlinkState();
+}
+
+float mcl::CaretComponent::getAlpha(double timeMs) const
+{
+	auto smooth = [](double x) { return (float)(x * x * (3.0 - 2.0 * x)); };
+
+	auto p = std::fmod(timeMs, BlinkPeriodMs);
+	auto half = BlinkPeriodMs * 0.5;
+
+	if (p < half - FadeMs)
+		return 1.0f;
+
+	if (p < half)
+		return 1.0f - smooth((p - (half - FadeMs)) / FadeMs);
+
+	if (p < BlinkPeriodMs - FadeMs)
+		return 0.0f;
+
+	return smooth((p - (BlinkPeriodMs - FadeMs)) / FadeMs);
+}
+
+double mcl::CaretComponent::getMillisecondsUntilNextFade(double timeMs) const
+{
+	auto p = std::fmod(timeMs, BlinkPeriodMs);
+	auto half = BlinkPeriodMs * 0.5;
+
+	if (p < half - FadeMs)
+		return half - FadeMs - p;
+
+	if (p < half)
+		return 0.0;
+
+	if (p < BlinkPeriodMs - FadeMs)
+		return BlinkPeriodMs - FadeMs - p;
+
+	return 0.0;
+}
+
+void mcl::CaretComponent::timerCallback()
+{
+	updateBlinkState();
 }
 
-float mcl::CaretComponent::squareWave(float wt) const
+void mcl::CaretComponent::updateBlinkState()
 {
-	if (isTimerRunning())
+	if (!shouldBlink)
 	{
-		const float delta = 0.222f;
-		const float A = 1.0;
-		return 0.5f + A / 3.14159f * std::atanf(std::cosf(wt) / delta);
+		suspendBlinkUpdates();
+		return;
 	}
-	
-	return 0.6f;
 
-	
-	
+	if (!isShowing())
+	{
+		// visibilityChanged() isn't called if a parent is hidden or the window is
+		// minimised, so this polls slowly until the caret is showing again
+		suspendBlinkUpdates();
+		wasHidden = true;
+		startTimer(HiddenPollIntervalMs);
+		return;
+	}
+
+	if (wasHidden)
+	{
+		// restart the phase, so the caret is visible when the editor is shown again
+		wasHidden = false;
+		blinkStart = Time::getMillisecondCounterHiRes();
+		lastAlphaStep = -1;
+		repaintCaretAreas();
+	}
+
+	auto t = Time::getMillisecondCounterHiRes() - blinkStart;
+	auto alphaStep = roundToInt(getAlpha(t) * 32.0f);
+
+	if (alphaStep != lastAlphaStep)
+	{
+		lastAlphaStep = alphaStep;
+
+		// the current line strip doesn't depend on the alpha, so only the
+		// caret rectangles need to be repainted during a fade
+		for (const auto& a : lastBlinkAreas)
+			repaint(a);
+	}
+
+	auto msUntilNextFade = getMillisecondsUntilNextFade(t);
+
+	if (msUntilNextFade > 0.0)
+	{
+		// Sleep until the next fade starts
+#if MCL_CARET_USES_VBLANK
+		vblank.reset();
+#endif
+		startTimer(jmax(1, roundToInt(msUntilNextFade)));
+	}
+	else
+	{
+#if MCL_CARET_USES_VBLANK
+		stopTimer();
+
+		if (vblank == nullptr)
+			vblank.reset(new VBlankAttachment(this, [this]() { updateBlinkState(); }));
+#else
+		startTimerHz(60);
+#endif
+	}
 }
 
-void mcl::CaretComponent::timerCallback()
+void mcl::CaretComponent::suspendBlinkUpdates()
 {
-	phase += 3.2e-1;
+	stopTimer();
 
-	for (const auto &r : getCaretRectangles())
-		repaint(r.getSmallestIntegerContainer());
+#if MCL_CARET_USES_VBLANK
+	vblank.reset();
+#endif
+}
+
+void mcl::CaretComponent::repaintCaretAreas()
+{
+	for (const auto& a : lastCaretAreas)
+		repaint(a);
+
+	lastCaretAreas = getCaretAreas(true);
+	lastBlinkAreas = getCaretAreas(false);
+
+	for (const auto& a : lastCaretAreas)
+		repaint(a);
+}
+
+Array<Rectangle<int>> mcl::CaretComponent::getCaretAreas(bool includeCaretLine) const
+{
+	Array<Rectangle<int>> areas;
+
+	bool drawCaretLine = includeCaretLine && document.getNumSelections() == 1 && document.getSelections().getFirst().isSingular();
+
+	for (const auto& r : getCaretRectangles())
+	{
+		// the caret is drawn with a fixed physical width, so leave some room
+		areas.add(r.expanded(2.0f, 0.0f).getSmallestIntegerContainer());
+
+		if (drawCaretLine)
+			areas.add(r.withX(0.0f).withWidth((float)getWidth()).getSmallestIntegerContainer());
+	}
+
+	return areas;
 }
 
 Array<Rectangle<float>> mcl::CaretComponent::getCaretRectangles() const
@@ -1,6 +1,6 @@
 /** ============================================================================
  *
- * MCL Text Editor JUCE module 
+ * MCL Text Editor JUCE module
  *
  * Copyright (C) Jonathan Zrake, Christoph Hart
  *
@@ -16,8 +16,23 @@ namespace mcl
 {
 using namespace juce;
 
+/** The VBlankAttachment was added in JUCE 6.1, older versions use a timer for the blink fades. */
+#define MCL_CARET_USES_VBLANK (JUCE_MAJOR_VERSION > 6 || (JUCE_MAJOR_VERSION == 6 && JUCE_MINOR_VERSION >= 1))
+
 
 //==============================================================================
+/** Draws the caret(s) and the current line highlight.
+
+	The blink phase is derived from the time since the last selection change.
+	The caret is fully visible or hidden most of the time, so it only wakes up
+	at the start of each fade and then repaints every frame until the fade is
+	done. Only the caret rectangles are repainted during a fade, the current
+	line is only repainted when the carets move.
+
+	The blinking stops when the editor loses the keyboard focus. While the
+	component is not showing, it only polls every HiddenPollIntervalMs until
+	it's shown again.
+*/
 class mcl::CaretComponent : public juce::Component, public juce::Timer
 {
 public:
@@ -25,22 +40,47 @@ public:
 	void setViewTransform(const juce::AffineTransform& transformToUse);
 	void updateSelections();
 
+	/** Starts blinking. This is called when the editor gains the keyboard focus. */
+	void startBlinking();
+
+	/** Stops blinking and shows the caret with a static alpha. */
+	void stopBlinking();
+
 	//==========================================================================
 	void paint(juce::Graphics& g) override;
+	void visibilityChanged() override;
+	void parentHierarchyChanged() override;
 
-	
+	static constexpr double BlinkPeriodMs = 1000.0;
+	static constexpr double FadeMs = 120.0;
+	static constexpr int HiddenPollIntervalMs = 250;
 
 private:
 	//==========================================================================
-	float squareWave(float wt) const;
+	float getAlpha(double timeMs) const;
+	double getMillisecondsUntilNextFade(double timeMs) const;
 	void timerCallback() override;
+	void updateBlinkState();
+	void suspendBlinkUpdates();
+	void repaintCaretAreas();
 	juce::Array<juce::Rectangle<float>> getCaretRectangles() const;
+	juce::Array<juce::Rectangle<int>> getCaretAreas(bool includeCaretLine) const;
 	//==========================================================================
-	float phase = 0.f;
+	bool shouldBlink = false;
+	bool wasHidden = false;
+	double blinkStart = 0.0;
+	int lastAlphaStep = -1;
+	juce::Array<juce::Rectangle<int>> lastCaretAreas;
+	juce::Array<juce::Rectangle<int>> lastBlinkAreas;
+
+#if MCL_CARET_USES_VBLANK
+	std::unique_ptr<juce::VBlankAttachment> vblank;
+#endif
+
 	const TextDocument& document;
 	juce::AffineTransform transform;
 };
 
 
 
-}
\ No newline at end of file
+}
@@ -158,6 +158,8 @@ juce::Rectangle<int> mcl::CodeMap::getPreviewBounds(const MouseEvent& e)
 
 void mcl::CodeMap::paint(Graphics& g)
 {
+	Profiler::ScopedTimer st(Profiler::Minimap);
+
 	if (!isActive())
 	{
 		return;
@@ -183,9 +185,7 @@ void mcl::CodeMap::paint(Graphics& g)
 			if (start.x == end.x && start.y > end.y)
 				std::swap(start, end);
 
-			CodeDocument::Position startPos(doc.getCodeDocument(), start.x, start.y);
-			CodeDocument::Position endPos(doc.getCodeDocument(), end.x, end.y);
-			selectedLines.addRange({ startPos.getPosition(), endPos.getPosition() + 1 });
+			selectedLines.addRange({ doc.getCharacterOffset(start), doc.getCharacterOffset(end) + 1 });
 		}
 	}
 
@@ -317,85 +317,268 @@ void mcl::CodeMap::setVisibleRange(Range<int> visibleLines)
 
 }
 
+//==============================================================================
+uint8 MinimapKernel::getDensity(juce_wchar c)
+{
+	if (CharacterFunctions::isWhitespace(c))
+		return 0;
+
+	auto randomValue = (float)(((uint32)c * 120954801u) % 313u) / 313.0f;
+	return (uint8)roundToInt(jlimit(0.0f, 1.0f, 0.4f + randomValue) * 255.0f);
+}
+
+void MinimapKernel::applyTokenRuns(const TokenRun* runs, int numRuns, Row& row)
+{
+	for (int i = 0; i < numRuns; i++)
+	{
+		auto start = jlimit(0, row.numColumns, runs[i].start);
+		auto end = (int)jmin((int64)row.numColumns, (int64)runs[i].start + (int64)runs[i].length);
+
+		if (end > start)
+			memset(row.tokens + start, jlimit(0, 255, runs[i].token), (size_t)(end - start));
+	}
+}
+
+int MinimapKernel::processCharacter(juce_wchar c, int column, Row& row)
+{
+	uint8 f = 0;
+
+	if (CharacterFunctions::isWhitespace(c))
+		f |= Whitespace;
+	else if (CharacterFunctions::isUpperCase(c))
+		f |= Upper;
+
+	row.flags[column] = f;
+	row.density[column] = getDensity(c);
+
+	return column + 1;
+}
+
+int MinimapKernel::process(const char* utf8, int numBytes, const TokenRun* runs, int numRuns, Row& row)
+{
+	struct AsciiTables
+	{
+		AsciiTables()
+		{
+			for (int i = 0; i < 128; i++)
+			{
+				density[i] = getDensity((juce_wchar)i);
+				flags[i] = CharacterFunctions::isWhitespace((char)i) ? Whitespace : (CharacterFunctions::isUpperCase((juce_wchar)i) ? Upper : 0);
+			}
+		}
+
+		uint8 density[128];
+		uint8 flags[128];
+	};
+
+	static const AsciiTables tables;
+
+	row.ensureStorageAllocated(numBytes);
+
+	auto bytes = reinterpret_cast<const uint8*>(utf8);
+	int i = 0;
+	int column = 0;
+
+	while (i < numBytes)
+	{
+#if MCL_SIMD_AVAILABLE
+		if (i + ByteBlock::Size <= numBytes)
+		{
+			using B = ByteBlock;
+
+			auto b = B::load(bytes + i);
+
+			if (B::isAscii(b))
+			{
+				auto ws = B::bitOr(B::equal(b, B::broadcast(' ')), B::inRange(b, 9, 13));
+				auto up = B::inRange(b, 'A', 'Z');
+
+				B::store(row.flags + column, B::bitOr(B::bitAnd(ws, B::broadcast(Whitespace)),
+					                                  B::bitAnd(up, B::broadcast(Upper))));
+
+				for (int k = 0; k < B::Size; k++)
+					row.density[column + k] = tables.density[bytes[i + k]];
+
+				i += B::Size;
+				column += B::Size;
+				continue;
+			}
+		}
+#endif
+
+		auto c = bytes[i];
+
+		if (c < 0x80)
+		{
+			row.flags[column] = tables.flags[c];
+			row.density[column] = tables.density[c];
+			column++;
+			i++;
+		}
+		else
+		{
+			CharPointer_UTF8 p(utf8 + i);
+			column = processCharacter(p.getAndAdvance(), column, row);
+			i = jmax(i + 1, (int)(p.getAddress() - utf8));
+		}
+	}
+
+	row.numColumns = column;
+	applyTokenRuns(runs, numRuns, row);
+
+	return column;
+}
+
+int MinimapKernel::processPerCharacter(const char* utf8, int numBytes, const TokenRun* runs, int numRuns, Row& row)
+{
+	row.ensureStorageAllocated(numBytes);
+
+	CharPointer_UTF8 p(utf8);
+	auto end = utf8 + numBytes;
+	int column = 0;
+
+	while (p.getAddress() < end && !p.isEmpty())
+		column = processCharacter(p.getAndAdvance(), column, row);
+
+	row.numColumns = column;
+	applyTokenRuns(runs, numRuns, row);
+
+	return column;
+}
+
 void mcl::CodeMap::rebuild()
 {
-	colouredRectangles.clear();
+	Profiler::ScopedTimer st(Profiler::Minimap);
+
+	colouredRectangles.clearQuick();
 
 	if (!isActive())
 		return;
 
-	CodeDocument::Iterator it(doc.getCodeDocument());
+	auto& cd = doc.getCodeDocument();
 
-	auto lineLength = (float)doc.getCodeDocument().getMaximumLineLength();
+	auto lineLength = (float)doc.getMaximumLineLength();
 
 	auto xScale = (float)(getWidth() - 6) / jlimit(1.0f, 80.0f, lineLength);
 
 	if (tokeniser != nullptr)
 	{
+		struct Boundary
+		{
+			int line;
+			int column;
+			int token;
+		};
 
+		Array<Boundary> boundaries;
+
+		CodeDocument::Iterator it(cd);
+
+		int currentLine = -1;
+		int currentLineStart = 0;
 
 		while (!it.isEOF())
 		{
-			CodeDocument::Position start(doc.getCodeDocument(), it.getPosition());
-			auto token = tokeniser->readNextToken(it);
+			auto line = it.getLine();
+
+			if (line != currentLine)
+			{
+				currentLine = line;
+				currentLineStart = doc.getLineOffsets().getLineStart(line);
+			}
 
-			auto colour = colourScheme.types[token].colour;
+			auto column = it.getPosition() - currentLineStart;
+			auto token = tokeniser->readNextToken(it);
 
 			if (token == 0)
 				break;
 
-			CodeDocument::Position end(doc.getCodeDocument(), it.getPosition());
+			boundaries.add({ line, column, token });
+		}
+
+		if (boundaries.isEmpty())
+		{
+			repaint();
+			return;
+		}
+
+		float height = (float)getHeight() / (float)getNumLinesToShow();
 
-			auto startLine = start.getLineNumber();
-			auto endLine = end.getLineNumber();
+		// the last token (eg. a block comment) can span the lines after its boundary,
+		// which are covered by the carried token
+		auto numLines = cd.getNumLines();
 
-			auto pos = start;
+		Array<MinimapKernel::TokenRun> runs;
+		int boundaryIndex = 0;
+		int carriedToken = boundaries.getFirst().token;
 
-			auto h = getHeight();
+		colouredRectangles.ensureStorageAllocated(cd.getNumCharacters());
 
-			float height = (float)getHeight() / (float)getNumLinesToShow();
+		for (int lineNumber = 0; lineNumber < numLines; lineNumber++)
+		{
+			runs.clearQuick();
+
+			if (boundaryIndex >= boundaries.size() || boundaries[boundaryIndex].line != lineNumber || boundaries[boundaryIndex].column > 0)
+				runs.add({ 0, std::numeric_limits<int>::max(), carriedToken });
 
-			while (pos != end)
+			while (boundaryIndex < boundaries.size() && boundaries[boundaryIndex].line == lineNumber)
 			{
-				float randomValue = (float)((pos.getCharacter() * 120954801) % 313) / 313.0f;
+				auto b = boundaries[boundaryIndex++];
+
+				if (!runs.isEmpty())
+				{
+					auto& last = runs.getReference(runs.size() - 1);
+					last.length = b.column - last.start;
+				}
+
+				runs.add({ b.column, std::numeric_limits<int>::max(), b.token });
+				carriedToken = b.token;
+			}
+
+			auto text = cd.getLine(lineNumber);
+			auto utf8 = text.toRawUTF8();
+			auto numBytes = (int)std::strlen(utf8);
+
+			auto numColumns = MinimapKernel::process(utf8, numBytes, runs.begin(), runs.size(), kernelRow);
+			auto lineStart = doc.getLineOffsets().getLineStart(lineNumber);
 
-				auto x = 3.0f + xScale * (float)pos.getIndexInLine();
-				auto h = height;
-				auto y = (float)pos.getLineNumber() * h;
-				auto w = xScale;
+			auto y = (float)lineNumber * height;
 
+			for (int column = 0; column < numColumns; column++)
+			{
 				ColouredRectangle r;
-				r.lineNumber = pos.getLineNumber();
-				r.position = pos.getPosition();
+				r.lineNumber = lineNumber;
+				r.position = lineStart + column;
 
-				if (!CharacterFunctions::isWhitespace(pos.getCharacter()))
+				if (!kernelRow.isWhitespace(column))
 				{
-					r.upper = CharacterFunctions::isUpperCase(pos.getCharacter());
-
-					auto alpha = jlimit(0.0f, 1.0f, 0.4f + randomValue);
+					r.upper = kernelRow.isUpper(column);
 
-					r.c = colour.withAlpha(alpha);
+					auto alpha = (float)kernelRow.density[column] / 255.0f;
 
+					r.c = colourScheme.types[kernelRow.tokens[column]].colour.withAlpha(alpha);
 				}
 				else
 				{
+					r.upper = false;
 					r.c = Colours::transparentBlack;
 				}
 
-				r.area = { x, y, w, h };
+				r.area = { 3.0f + xScale * (float)column, y, xScale, height };
 
 				colouredRectangles.add(r);
-
-				pos.moveBy(1);
 			}
 		}
 	}
 
-
-
 	repaint();
 }
 
+void mcl::CodeMap::addMemoryUsage(MemoryUsage& m) const
+{
+	m.add(MemoryUsage::CodeMap, MemoryUsage::getArrayBytes(colouredRectangles) + (int64)kernelRow.numAllocated * 3);
+}
+
 int mcl::CodeMap::yToLine(float y) const
 {
 	auto normalised = y / (float)getHeight();
@@ -491,11 +674,23 @@ void mcl::CodeMap::HoverPreview::paint(Graphics& g)
 
 	g.setColour(Colours::black);
 
+	auto rowRange = document.getRangeOfRowsIntersecting(displayBounds);
+	auto visibleRange = getLocalBounds().toFloat().transformedBy(transform).getHorizontalRange();
+
 	for (int i = 0; i < colourScheme.types.size(); i++)
 	{
 		g.setColour(colourScheme.types[i].colour);
-		auto glyphs = document.findGlyphsIntersecting(displayBounds, i);
-		glyphs.draw(g);
+
+		for (int r = rowRange.getStart(); r < rowRange.getEnd(); r++)
+		{
+			if (document.getFoldableLineRangeHolder().isFolded(r))
+				continue;
+
+			auto chunks = document.getChunksIntersecting(r, visibleRange);
+
+			for (int c = chunks.getStart(); c < chunks.getEnd(); c++)
+				document.getGlyphRunForRow(r, i, false, c).draw(g);
+		}
 	}
 
 	g.restoreState();
@@ -408,6 +408,71 @@ public:
 };
 
 
+/** The kernel that turns the text of a line into a row of minimap cells.
+
+	It takes the raw UTF-8 bytes of the line and the list of token runs and writes the
+	density (the alpha value of the cell, zero for whitespace), the flags (whitespace / uppercase)
+	and the token index for each column in one pass. Blocks of 16 ASCII characters are classified
+	with SSE2 / NEON, everything else goes through the scalar path.
+*/
+struct MinimapKernel
+{
+	enum CellFlags
+	{
+		Whitespace = 1,
+		Upper = 2
+	};
+
+	/** A token that starts at the given column. The length may exceed the line length. */
+	struct TokenRun
+	{
+		int start;
+		int length;
+		int token;
+	};
+
+	/** The output of the kernel. The buffers are reused between lines. */
+	struct Row
+	{
+		void ensureStorageAllocated(int numColumnsToHold)
+		{
+			if (numColumnsToHold > numAllocated)
+			{
+				numAllocated = jmax(numColumnsToHold, numAllocated * 2, 128);
+				density.realloc(numAllocated);
+				flags.realloc(numAllocated);
+				tokens.realloc(numAllocated);
+			}
+		}
+
+		bool isWhitespace(int column) const { return (flags[column] & Whitespace) != 0; }
+		bool isUpper(int column) const { return (flags[column] & Upper) != 0; }
+
+		HeapBlock<uint8> density;
+		HeapBlock<uint8> flags;
+		HeapBlock<uint8> tokens;
+
+		int numColumns = 0;
+		int numAllocated = 0;
+	};
+
+	/** Processes the line and returns the number of columns written to the row. */
+	static int process(const char* utf8, int numBytes, const TokenRun* runs, int numRuns, Row& row);
+
+	/** The per-character reference implementation (the path that CodeMap::rebuild() used before).
+		This is the scalar fallback for the benchmark, the results are the same as process(). */
+	static int processPerCharacter(const char* utf8, int numBytes, const TokenRun* runs, int numRuns, Row& row);
+
+	/** Returns the pseudo-random density for the given character. */
+	static uint8 getDensity(juce_wchar c);
+
+private:
+
+	static void applyTokenRuns(const TokenRun* runs, int numRuns, Row& row);
+	static int processCharacter(juce_wchar c, int column, Row& row);
+};
+
+
 class mcl::CodeMap : public Component,
 	public CodeDocument::Listener,
 	public Timer,
@@ -464,6 +529,8 @@ public:
 
 	float getLineNumberFromEvent(const MouseEvent& e) const;
 
+	void addMemoryUsage(MemoryUsage& m) const;
+
 	Rectangle<int> getPreviewBounds(const MouseEvent& e);
 
 	void mouseEnter(const MouseEvent& e) override;
@@ -545,6 +612,8 @@ public:
 
 	Array<ColouredRectangle> colouredRectangles;
 
+	MinimapKernel::Row kernelRow;
+
 	CodeEditorComponent::ColourScheme colourScheme;
 
 	TextDocument& doc;
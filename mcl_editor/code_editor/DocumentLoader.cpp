@@ -0,0 +1,231 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+mcl::DocumentLoader::DocumentLoader(CodeDocument& doc_) :
+	Thread("DocumentLoaderThread"),
+	doc(doc_)
+{
+	doc.addListener(this);
+}
+
+mcl::DocumentLoader::~DocumentLoader()
+{
+	cancel();
+	doc.removeListener(this);
+}
+
+bool mcl::DocumentLoader::load(const File& f)
+{
+	cancel();
+
+	if (!f.existsAsFile())
+		return false;
+
+	// The CodeDocument uses int positions, so larger files can't be edited
+	if (f.getSize() >= (int64)std::numeric_limits<int>::max())
+		return false;
+
+	mappedFile.reset(new MemoryMappedFile(f, MemoryMappedFile::readOnly));
+
+	if (mappedFile->getData() == nullptr)
+	{
+		mappedFile = nullptr;
+
+		if (f.getSize() != 0)
+			return false;
+
+		{
+			ScopedValueSetter<bool> svs(changingDocument, true);
+			doc.replaceAllContent({});
+		}
+
+		doc.clearUndoHistory();
+
+		if (onLoadFinished)
+			onLoadFinished();
+
+		return true;
+	}
+
+	auto start = getData();
+	auto end = getEnd();
+
+	// skip the UTF-8 byte order mark
+	if (end - start >= 3 && (uint8)start[0] == 0xEF && (uint8)start[1] == 0xBB && (uint8)start[2] == 0xBF)
+		start += 3;
+
+	auto firstBatchEnd = findEndOfBatch(start, end, NumInitialLines);
+
+	{
+		ScopedValueSetter<bool> svs(changingDocument, true);
+		doc.replaceAllContent(String::fromUTF8(start, (int)(firstBatchEnd - start)));
+	}
+
+	doc.clearUndoHistory();
+
+	loadedEnd = doc.getNumCharacters();
+	numBytesAdded = firstBatchEnd - getData();
+	numBytesScanned = numBytesAdded;
+
+	if (firstBatchEnd == end)
+	{
+		mappedFile = nullptr;
+
+		if (onLoadFinished)
+			onLoadFinished();
+
+		return true;
+	}
+
+	scanFinished = false;
+	startThread();
+	return true;
+}
+
+void mcl::DocumentLoader::cancel()
+{
+	stopThread(2000);
+	cancelPendingUpdate();
+
+	ScopedLock sl(lock);
+	pendingBatches.clear();
+	scanFinished = false;
+	mappedFile = nullptr;
+}
+
+double mcl::DocumentLoader::getProgress() const
+{
+	if (mappedFile == nullptr || mappedFile->getSize() == 0)
+		return 1.0;
+
+	return (double)numBytesAdded / (double)mappedFile->getSize();
+}
+
+void mcl::DocumentLoader::codeDocumentTextInserted(const String& newText, int insertIndex)
+{
+	// Text that is inserted at the end of the loaded text (eg. typed at the end of the
+	// document) stays after it, so only the insertions before it move the end
+	if (!changingDocument && isLoading() && insertIndex < loadedEnd)
+		loadedEnd += newText.length();
+}
+
+void mcl::DocumentLoader::codeDocumentTextDeleted(int startIndex, int endIndex)
+{
+	if (!changingDocument && isLoading() && startIndex < loadedEnd)
+		loadedEnd -= jmin(endIndex, loadedEnd) - startIndex;
+}
+
+const char* mcl::DocumentLoader::findEndOfBatch(const char* start, const char* end, int numLines) const noexcept
+{
+	auto limit = end - start > MaxBatchSize ? start + MaxBatchSize : end;
+	auto p = start;
+
+	LineScanner::skipLines(p, limit, numLines);
+
+	if (p == end)
+		return p;
+
+	// The batch ends within a line, so make sure that it doesn't split
+	// a UTF-8 sequence or a CR LF pair
+	while (p > start && ((uint8)*p & 0xC0) == 0x80)
+		--p;
+
+	if (p > start && p[-1] == '\r' && *p == '\n')
+		++p;
+
+	return p > start ? p : limit;
+}
+
+void mcl::DocumentLoader::run()
+{
+	auto p = getData() + numBytesScanned.load();
+	auto end = getEnd();
+
+	while (p < end && !threadShouldExit())
+	{
+		{
+			ScopedLock sl(lock);
+
+			if (pendingBatches.size() >= MaxNumPendingBatches)
+			{
+				ScopedUnlock sul(lock);
+				wait(100);
+				continue;
+			}
+		}
+
+		auto batchEnd = findEndOfBatch(p, end, NumLinesPerBatch);
+		auto text = String::fromUTF8(p, (int)(batchEnd - p));
+
+		{
+			ScopedLock sl(lock);
+			pendingBatches.add(text);
+		}
+
+		p = batchEnd;
+		numBytesScanned = p - getData();
+		triggerAsyncUpdate();
+	}
+
+	if (!threadShouldExit())
+	{
+		ScopedLock sl(lock);
+		scanFinished = true;
+		triggerAsyncUpdate();
+	}
+}
+
+void mcl::DocumentLoader::handleAsyncUpdate()
+{
+	StringArray batches;
+	bool finished;
+
+	{
+		ScopedLock sl(lock);
+		batches.swapWith(pendingBatches);
+		finished = scanFinished;
+	}
+
+	// wake up the thread if it waits for the queue
+	notify();
+
+	{
+		ScopedValueSetter<bool> svs(changingDocument, true);
+
+		for (const auto& b : batches)
+		{
+			doc.insertText(loadedEnd, b);
+			loadedEnd += b.length();
+			numBytesAdded += (int64)b.getNumBytesAsUTF8();
+		}
+	}
+
+	// The CodeDocument keeps an undo action with the text of every insertion
+	doc.clearUndoHistory();
+
+	if (finished)
+	{
+		stopThread(1000);
+		mappedFile = nullptr;
+
+		if (onLoadFinished)
+			onLoadFinished();
+	}
+}
+
+
+}
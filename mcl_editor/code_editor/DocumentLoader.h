@@ -0,0 +1,105 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+/**
+	Loads a file into a CodeDocument without creating a String of the whole file.
+
+	The file is memory mapped and the first NumInitialLines lines are added
+	synchronously, so the editor can show the first screen right away. A background
+	thread then finds the line breaks of the rest of the file and converts batches
+	of lines to Strings, which are appended to the document on the message thread.
+
+	The TextDocument picks up every batch like a regular insertion, so this doesn't
+	need any special handling in the editor and the peak memory usage is the document
+	plus a few batches. The batches are inserted at the end of the loaded text, which
+	is tracked through the edits of the document, so text that is typed at the end of
+	the document while it's loading stays after the content of the file.
+*/
+class DocumentLoader : public Thread,
+					   public AsyncUpdater,
+					   private CodeDocument::Listener
+{
+public:
+
+	static constexpr int NumInitialLines = 512;
+	static constexpr int NumLinesPerBatch = 16384;
+
+	/** The maximum size of a batch, so a file without line breaks is split up too. */
+	static constexpr int MaxBatchSize = 4 * 1024 * 1024;
+
+	/** The number of batches that can wait for the message thread. */
+	static constexpr int MaxNumPendingBatches = 4;
+
+	DocumentLoader(CodeDocument& doc);
+	~DocumentLoader();
+
+	/** Replaces the content of the document with the file. Returns false if the file can't be mapped. */
+	bool load(const File& f);
+
+	/** Stops the background thread and removes the batches that weren't added yet. */
+	void cancel();
+
+	/** Returns true until the last batch was added to the document. */
+	bool isLoading() const { return mappedFile != nullptr; }
+
+	/** Returns true while the loader itself changes the document, so a listener can tell
+		its changes apart from the ones that replace the content while it's loading.
+	*/
+	bool isChangingDocument() const { return changingDocument; }
+
+	/** Returns the number of bytes that were added to the document divided by the file size. */
+	double getProgress() const;
+
+	/** Called on the message thread after the last batch was added. */
+	std::function<void()> onLoadFinished;
+
+private:
+
+	void run() override;
+	void handleAsyncUpdate() override;
+
+	void codeDocumentTextInserted(const String& newText, int insertIndex) override;
+	void codeDocumentTextDeleted(int startIndex, int endIndex) override;
+
+	/** Returns the end of the next batch, which is never within a UTF-8 sequence. */
+	const char* findEndOfBatch(const char* start, const char* end, int numLines) const noexcept;
+
+	const char* getData() const { return static_cast<const char*>(mappedFile->getData()); }
+	const char* getEnd() const { return getData() + mappedFile->getSize(); }
+
+	CodeDocument& doc;
+	std::unique_ptr<MemoryMappedFile> mappedFile;
+
+	CriticalSection lock;
+	StringArray pendingBatches;
+	bool scanFinished = false;
+	bool changingDocument = false;
+
+	int64 numBytesAdded = 0;
+
+	/** The character index after the text of the file that was added so far. */
+	int loadedEnd = 0;
+	std::atomic<int64> numBytesScanned = { 0 };
+
+	JUCE_DECLARE_NON_COPYABLE(DocumentLoader);
+};
+
+
+}
@@ -0,0 +1,510 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+mcl::MappedTextFile::MappedTextFile() :
+	Thread("MappedTextFileIndexer")
+{
+	resetIndex();
+}
+
+mcl::MappedTextFile::~MappedTextFile()
+{
+	close();
+}
+
+bool mcl::MappedTextFile::open(const File& f)
+{
+	close();
+
+	if (!f.existsAsFile())
+		return false;
+
+	{
+		ScopedLock sl(lock);
+
+		mappedFile.reset(new MemoryMappedFile(f, MemoryMappedFile::readOnly));
+
+		// an empty file can't be mapped, but it's still a valid file
+		if (mappedFile->getData() == nullptr && f.getSize() != 0)
+		{
+			mappedFile = nullptr;
+			return false;
+		}
+	}
+
+	file = f;
+	lastModificationTime = f.getLastModificationTime();
+	startThread();
+	return true;
+}
+
+void mcl::MappedTextFile::close()
+{
+	stopThread(2000);
+
+	ScopedLock sl(lock);
+	mappedFile = nullptr;
+	resetIndex();
+	file = File();
+}
+
+int mcl::MappedTextFile::getNumLines() const
+{
+	ScopedLock sl(lock);
+	return mappedFile != nullptr ? numCompleteLines + 1 : 0;
+}
+
+juce::int64 mcl::MappedTextFile::getFileSize() const
+{
+	ScopedLock sl(lock);
+	return mappedFile != nullptr ? (int64)mappedFile->getSize() : 0;
+}
+
+bool mcl::MappedTextFile::isIndexing() const
+{
+	ScopedLock sl(lock);
+	return mappedFile != nullptr && numBytesIndexed < (int64)mappedFile->getSize();
+}
+
+void mcl::MappedTextFile::setFollowChanges(bool shouldFollow)
+{
+	followChanges = shouldFollow;
+	notify();
+}
+
+StringArray mcl::MappedTextFile::getLines(int firstLine, int numLines, Array<int64>* numBytesCutOff) const
+{
+	StringArray lines;
+
+	ScopedLock sl(lock);
+
+	if (mappedFile == nullptr)
+		return lines;
+
+	firstLine = jlimit(0, numCompleteLines, firstLine);
+	numLines = jmin(numLines, numCompleteLines + 1 - firstLine);
+
+	auto data = static_cast<const char*>(mappedFile->getData());
+
+	if (data == nullptr)
+	{
+		if (numLines > 0)
+		{
+			lines.add({});
+
+			if (numBytesCutOff != nullptr)
+				numBytesCutOff->add(0);
+		}
+
+		return lines;
+	}
+
+	// only the indexed part is used, so the lines match the line count
+	auto end = data + numBytesIndexed;
+	auto p = data + checkpoints[firstLine / LinesPerCheckpoint];
+
+	LineScanner::skipLines(p, end, firstLine % LinesPerCheckpoint);
+
+	for (int i = 0; i < numLines; i++)
+	{
+		auto lineStart = p;
+		LineScanner::skipLines(p, end, 1);
+		auto lineEnd = p;
+
+		if (lineEnd > lineStart && lineEnd[-1] == '\n')
+			--lineEnd;
+
+		if (lineEnd > lineStart && lineEnd[-1] == '\r')
+			--lineEnd;
+
+		auto fullLineEnd = lineEnd;
+
+		if (lineEnd - lineStart > MaxLineLength)
+		{
+			lineEnd = lineStart + MaxLineLength;
+
+			while (lineEnd > lineStart && ((uint8)*lineEnd & 0xC0) == 0x80)
+				--lineEnd;
+		}
+
+		lines.add(String::fromUTF8(lineStart, (int)(lineEnd - lineStart)));
+
+		if (numBytesCutOff != nullptr)
+			numBytesCutOff->add((int64)(fullLineEnd - lineEnd));
+	}
+
+	return lines;
+}
+
+juce::int64 mcl::MappedTextFile::getNumBytes() const
+{
+	ScopedLock sl(lock);
+	return MemoryUsage::getArrayBytes(checkpoints);
+}
+
+void mcl::MappedTextFile::run()
+{
+	while (!threadShouldExit())
+	{
+		indexNewLines();
+
+		if (threadShouldExit())
+			break;
+
+		// sleep until the follow mode is enabled
+		wait(followChanges ? PollIntervalMs : -1);
+
+		if (followChanges)
+			remapIfChanged();
+	}
+}
+
+void mcl::MappedTextFile::indexNewLines()
+{
+	const char* data;
+	int64 size, position;
+
+	{
+		ScopedLock sl(lock);
+
+		if (mappedFile == nullptr || mappedFile->getData() == nullptr)
+			return;
+
+		// Only this thread changes the mapping, so the pointer stays valid without the lock
+		data = static_cast<const char*>(mappedFile->getData());
+		size = (int64)mappedFile->getSize();
+		position = numBytesIndexed;
+	}
+
+	while (position < size && !threadShouldExit())
+	{
+		auto p = data + position;
+		auto end = data + jmin(size, position + BytesPerSlice);
+
+		// a slice must not end between a CR and a LF (see LineScanner::skipLines())
+		if (end < data + size && end[-1] == '\r')
+			++end;
+
+		ScopedLock sl(lock);
+
+		while (p < end)
+		{
+			auto linesToCheckpoint = LinesPerCheckpoint - numCompleteLines % LinesPerCheckpoint;
+			auto numSkipped = LineScanner::skipLines(p, end, linesToCheckpoint);
+
+			numCompleteLines += numSkipped;
+
+			if (numSkipped == linesToCheckpoint)
+				checkpoints.add(p - data);
+		}
+
+		position = numBytesIndexed = p - data;
+
+		if (firstIndexedBytes.getSize() < (size_t)SampleSize)
+			firstIndexedBytes = MemoryBlock(data, (size_t)jmin((int64)SampleSize, position));
+
+		auto numLastBytes = jmin((int64)SampleSize, position);
+		lastIndexedBytes = MemoryBlock(data + position - numLastBytes, (size_t)numLastBytes);
+	}
+}
+
+void mcl::MappedTextFile::remapIfChanged()
+{
+	auto newSize = file.getSize();
+	auto modificationTime = file.getLastModificationTime();
+
+	if (newSize == getFileSize() && modificationTime == lastModificationTime)
+		return;
+
+	lastModificationTime = modificationTime;
+
+	std::unique_ptr<MemoryMappedFile> newMapping(new MemoryMappedFile(file, MemoryMappedFile::readOnly));
+
+	ScopedLock sl(lock);
+
+	// The file was truncated or replaced (eg. by a log rotation that wrote more
+	// than the old file already), so the checkpoints don't match its lines anymore
+	if (!containsIndexedBytes(*newMapping))
+		resetIndex();
+
+	mappedFile = std::move(newMapping);
+}
+
+bool mcl::MappedTextFile::containsIndexedBytes(const MemoryMappedFile& m) const
+{
+	if (numBytesIndexed == 0)
+		return true;
+
+	auto data = static_cast<const char*>(m.getData());
+
+	if (data == nullptr || (int64)m.getSize() < numBytesIndexed)
+		return false;
+
+	auto lastStart = data + numBytesIndexed - (int64)lastIndexedBytes.getSize();
+
+	return memcmp(data, firstIndexedBytes.getData(), firstIndexedBytes.getSize()) == 0 &&
+		   memcmp(lastStart, lastIndexedBytes.getData(), lastIndexedBytes.getSize()) == 0;
+}
+
+void mcl::MappedTextFile::resetIndex()
+{
+	checkpoints.clearQuick();
+	checkpoints.add(0);
+	numCompleteLines = 0;
+	numBytesIndexed = 0;
+	firstIndexedBytes.reset();
+	lastIndexedBytes.reset();
+}
+
+//==============================================================================
+mcl::FileViewer::FileViewer() :
+	font(Font::getDefaultMonospacedFontName(), 14.0f, Font::plain),
+	scrollBar(true)
+{
+	setOpaque(true);
+
+	addAndMakeVisible(scrollBar);
+	scrollBar.addListener(this);
+	scrollBar.setColour(ScrollBar::ColourIds::thumbColourId, Colours::white.withAlpha(0.2f));
+}
+
+mcl::FileViewer::~FileViewer()
+{
+	stopTimer();
+	scrollBar.removeListener(this);
+}
+
+bool mcl::FileViewer::loadFile(const File& f)
+{
+	cachedLines.clear();
+	firstVisibleLine = 0.0;
+	numLines = 0;
+	fileSize = 0;
+
+	if (!file.open(f))
+		return false;
+
+	file.setFollowChanges(following);
+	startTimer(100);
+	timerCallback();
+	return true;
+}
+
+void mcl::FileViewer::setFollowMode(bool shouldFollow)
+{
+	following = shouldFollow;
+	file.setFollowChanges(following);
+
+	if (following)
+	{
+		startTimer(100);
+		scrollToLine((double)numLines);
+	}
+}
+
+void mcl::FileViewer::setFont(const Font& newFont)
+{
+	font = newFont;
+	cachedLines.clear();
+	updateScrollBar();
+	repaint();
+}
+
+void mcl::FileViewer::scrollToLine(double line)
+{
+	auto maxLine = jmax(0.0, (double)(numLines - getNumVisibleLines() + 1));
+	firstVisibleLine = jlimit(0.0, maxLine, line);
+
+	updateScrollBar();
+	repaint();
+}
+
+void mcl::FileViewer::addMemoryUsage(MemoryUsage& m) const
+{
+	m.add(MemoryUsage::Document, file.getNumBytes());
+
+	for (auto l : cachedLines)
+	{
+		if (l != nullptr)
+			m.add(MemoryUsage::Glyphs, MemoryUsage::getGlyphArrangementBytes(l->glyphs));
+	}
+}
+
+void mcl::FileViewer::paint(Graphics& g)
+{
+	g.fillAll(findColour(CodeEditorComponent::backgroundColourId));
+
+	updateVisibleLines();
+
+	auto lineHeight = getLineHeight();
+	auto y = (float)((double)firstCachedLine - firstVisibleLine) * lineHeight;
+	auto baseline = (lineHeight - font.getHeight()) / 2.0f + font.getAscent();
+
+	g.setColour(findColour(CodeEditorComponent::defaultTextColourId));
+
+	for (auto l : cachedLines)
+	{
+		if (l != nullptr)
+		{
+			l->glyphs.draw(g, AffineTransform::translation(0.0f, y + baseline));
+
+			if (l->numBytesCutOff > 0)
+			{
+				drawTruncationMarker(g, *l, y, lineHeight);
+				g.setColour(findColour(CodeEditorComponent::defaultTextColourId));
+			}
+		}
+
+		y += lineHeight;
+	}
+}
+
+void mcl::FileViewer::drawTruncationMarker(Graphics& g, const CachedLine& l, float y, float lineHeight) const
+{
+	auto text = "+" + File::descriptionOfSizeInBytes(l.numBytesCutOff);
+	auto markerFont = font.withHeight(font.getHeight() * 0.8f);
+
+	auto x = (l.glyphs.getNumGlyphs() > 0 ? l.glyphs.getBoundingBox(0, -1, true).getRight() : TEXT_INDENT) + 4.0f;
+	Rectangle<float> area(x, y, markerFont.getStringWidthFloat(text) + 8.0f, lineHeight);
+	area = area.reduced(0.0f, 2.0f);
+
+	auto c = findColour(CodeEditorComponent::defaultTextColourId);
+
+	g.setColour(c.withAlpha(0.15f));
+	g.fillRoundedRectangle(area, 3.0f);
+	g.setColour(c.withAlpha(0.6f));
+	g.setFont(markerFont);
+	g.drawText(text, area, Justification::centred, false);
+}
+
+void mcl::FileViewer::resized()
+{
+	auto b = getLocalBounds();
+	scrollBar.setBounds(b.removeFromRight(14));
+	updateScrollBar();
+}
+
+void mcl::FileViewer::mouseWheelMove(const MouseEvent& e, const MouseWheelDetails& d)
+{
+	ignoreUnused(e);
+	scrollToLine(firstVisibleLine - (double)d.deltaY * 10.0);
+}
+
+void mcl::FileViewer::scrollBarMoved(ScrollBar* bar, double newRangeStart)
+{
+	ignoreUnused(bar);
+	scrollToLine(newRangeStart);
+}
+
+void mcl::FileViewer::timerCallback()
+{
+	auto newNumLines = file.getNumLines();
+	auto newFileSize = file.getFileSize();
+
+	if (newNumLines == numLines && newFileSize == fileSize)
+	{
+		if (!following && !file.isIndexing())
+			stopTimer();
+
+		return;
+	}
+
+	if (newNumLines < numLines || newFileSize < fileSize)
+	{
+		// the file was truncated, so the cached lines might have changed
+		cachedLines.clear();
+	}
+	else
+	{
+		// the last line might have been extended
+		auto lastLine = jmax(0, numLines - 1 - firstCachedLine);
+		cachedLines.removeRange(lastLine, cachedLines.size() - lastLine);
+	}
+
+	numLines = newNumLines;
+	fileSize = newFileSize;
+
+	if (following)
+		scrollToLine((double)numLines);
+	else
+		updateScrollBar();
+
+	repaint();
+}
+
+int mcl::FileViewer::getNumVisibleLines() const
+{
+	return jmax(1, (int)std::ceil((float)getHeight() / getLineHeight()));
+}
+
+void mcl::FileViewer::updateVisibleLines()
+{
+	auto first = (int)firstVisibleLine;
+	auto num = jmin(getNumVisibleLines() + 1, numLines - first);
+
+	OwnedArray<CachedLine> visibleLines;
+	Range<int> missingLines;
+
+	// keep the glyphs of the lines that are still visible
+	for (int i = 0; i < num; i++)
+	{
+		auto index = first + i - firstCachedLine;
+
+		if (auto l = isPositiveAndBelow(index, cachedLines.size()) ? cachedLines.getUnchecked(index) : nullptr)
+		{
+			visibleLines.add(l);
+			cachedLines.set(index, nullptr, false);
+		}
+		else
+		{
+			visibleLines.add(nullptr);
+			missingLines = missingLines.isEmpty() ? Range<int>(i, i + 1) : missingLines.getUnionWith({ i, i + 1 });
+		}
+	}
+
+	if (!missingLines.isEmpty())
+	{
+		Array<int64> numBytesCutOff;
+		auto text = file.getLines(first + missingLines.getStart(), missingLines.getLength(), &numBytesCutOff);
+
+		for (int i = 0; i < text.size(); i++)
+		{
+			auto index = missingLines.getStart() + i;
+
+			if (visibleLines[index] == nullptr)
+			{
+				auto l = new CachedLine();
+				l->glyphs.addLineOfText(font, text[i], TEXT_INDENT, 0.0f);
+				l->numBytesCutOff = numBytesCutOff[i];
+				visibleLines.set(index, l, false);
+			}
+		}
+	}
+
+	// the glyphs of the lines that are not visible anymore are deleted here
+	cachedLines.swapWith(visibleLines);
+	firstCachedLine = first;
+}
+
+void mcl::FileViewer::updateScrollBar()
+{
+	scrollBar.setRangeLimits(0.0, (double)jmax(1, numLines + 1), dontSendNotification);
+	scrollBar.setCurrentRange(firstVisibleLine, (double)getNumVisibleLines(), dontSendNotification);
+}
+
+
+}
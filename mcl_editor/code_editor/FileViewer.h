@@ -0,0 +1,193 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+/**
+	A read-only view of a memory mapped text file with a sparse line index.
+
+	The index stores the byte offset of every LinesPerCheckpoint-th line, so its size
+	is a fraction of the number of lines and a line is found by skipping the lines
+	after its checkpoint. The file is indexed on a background thread, the lines that
+	are indexed so far can be read while it's running.
+
+	If follow mode is enabled, the thread polls the file size and modification time and
+	indexes the appended lines. The first and the last indexed bytes are kept, so a file
+	that was truncated or replaced (eg. by a log rotation) is indexed again from the start.
+*/
+class MappedTextFile : public Thread
+{
+public:
+
+	static constexpr int LinesPerCheckpoint = 4096;
+
+	/** Longer lines are cut off when they are read (getLines() reports how many bytes are missing). */
+	static constexpr int MaxLineLength = 4096;
+
+	MappedTextFile();
+	~MappedTextFile();
+
+	/** Maps the file and starts indexing it. Returns false if the file can't be mapped. */
+	bool open(const File& f);
+
+	void close();
+
+	/** Returns the number of lines that are indexed so far (this includes the last line without a line break). */
+	int getNumLines() const;
+
+	/** Returns the size of the file at the time it was mapped. */
+	int64 getFileSize() const;
+
+	/** Returns true if the background thread hasn't indexed the whole file yet. */
+	bool isIndexing() const;
+
+	/** Enables polling the file for appended lines. */
+	void setFollowChanges(bool shouldFollow);
+
+	/** Reads the lines from the file (without the line breaks). If numBytesCutOff is not null,
+		the number of bytes that were cut off is added for every line (0 if it's complete).
+	*/
+	StringArray getLines(int firstLine, int numLines, Array<int64>* numBytesCutOff = nullptr) const;
+
+	/** Returns the size of the line index. */
+	int64 getNumBytes() const;
+
+private:
+
+	static constexpr int PollIntervalMs = 250;
+	static constexpr int64 BytesPerSlice = 1024 * 1024;
+	static constexpr int SampleSize = 64;
+
+	void run() override;
+
+	/** Indexes the bytes of the mapping after the last indexed byte. */
+	void indexNewLines();
+
+	/** Maps the file again if it has changed its size or modification time. */
+	void remapIfChanged();
+
+	/** Returns true if the mapping starts with the bytes that are indexed so far. */
+	bool containsIndexedBytes(const MemoryMappedFile& m) const;
+
+	void resetIndex();
+
+	File file;
+	std::unique_ptr<MemoryMappedFile> mappedFile;
+
+	CriticalSection lock;
+	Array<int64> checkpoints;
+	int numCompleteLines = 0;
+	int64 numBytesIndexed = 0;
+
+	/** Copies of the first and the last indexed bytes. */
+	MemoryBlock firstIndexedBytes, lastIndexedBytes;
+	Time lastModificationTime;
+
+	std::atomic<bool> followChanges = { false };
+
+	JUCE_DECLARE_NON_COPYABLE(MappedTextFile);
+};
+
+
+//==============================================================================
+/**
+	A component that shows a MappedTextFile, eg. for multi gigabyte log files.
+
+	It doesn't create a CodeDocument or any per line data: only the visible lines are
+	read and shaped and their glyphs are dropped as soon as they are scrolled out of
+	view, so the memory usage doesn't depend on the file size. There's no editing,
+	no selection and no undo history. Lines that are longer than MaxLineLength end
+	with a marker that shows how much of the line is hidden.
+
+	In follow mode, the view polls the file and scrolls to the end when lines are
+	appended (like tail -f).
+*/
+class FileViewer : public Component,
+				   public ScrollBar::Listener,
+				   private Timer
+{
+public:
+
+	FileViewer();
+	~FileViewer();
+
+	/** Shows the file. Returns false if the file can't be mapped. */
+	bool loadFile(const File& f);
+
+	/** Enables polling the file and scrolling to the last line when it grows. */
+	void setFollowMode(bool shouldFollow);
+
+	bool isFollowing() const { return following; }
+
+	void setFont(const Font& newFont);
+
+	/** Scrolls the line to the top of the view. */
+	void scrollToLine(double line);
+
+	MappedTextFile& getFile() { return file; }
+
+	/** Adds the size of the line index and the visible glyphs. */
+	void addMemoryUsage(MemoryUsage& m) const;
+
+	void paint(Graphics& g) override;
+	void resized() override;
+	void mouseWheelMove(const MouseEvent& e, const MouseWheelDetails& d) override;
+	void scrollBarMoved(ScrollBar* bar, double newRangeStart) override;
+
+private:
+
+	void timerCallback() override;
+
+	float getLineHeight() const { return font.getHeight() * lineSpacing; }
+
+	int getNumVisibleLines() const;
+
+	/** Reads and shapes the visible lines that aren't in the cache. */
+	void updateVisibleLines();
+
+	void updateScrollBar();
+
+	MappedTextFile file;
+	Font font;
+	float lineSpacing = 1.333f;
+
+	ScrollBar scrollBar;
+
+	double firstVisibleLine = 0.0;
+	int numLines = 0;
+	int64 fileSize = 0;
+	bool following = false;
+
+	struct CachedLine
+	{
+		GlyphArrangement glyphs;
+		int64 numBytesCutOff = 0;
+	};
+
+	/** Draws the marker at the end of a line that was cut off. */
+	void drawTruncationMarker(Graphics& g, const CachedLine& l, float y, float lineHeight) const;
+
+	/** The glyphs of the visible lines, starting at firstCachedLine. */
+	int firstCachedLine = 0;
+	OwnedArray<CachedLine> cachedLines;
+
+	JUCE_DECLARE_NON_COPYABLE(FileViewer);
+};
+
+
+}
@@ -0,0 +1,427 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+namespace mcl
+{
+using namespace juce;
+
+#if MCL_ENABLE_OPEN_GL
+
+#if JUCE_MAJOR_VERSION > 6 || (JUCE_MAJOR_VERSION == 6 && JUCE_MINOR_VERSION >= 1)
+using namespace ::juce::gl;
+#endif
+
+
+//==============================================================================
+void mcl::GlyphAtlas::setFont(const Font& f, float newScale)
+{
+	if (f == font && newScale == scale && image.isValid())
+		return;
+
+	font = f;
+	scale = newScale;
+	scaledFont = font.withHeight(font.getHeight() * scale);
+
+	clear();
+
+	for (int c = 32; c < 127; c++)
+	{
+		Array<int> glyphNumbers;
+		Array<float> offsets;
+		scaledFont.getGlyphPositions(String::charToString((juce_wchar)c), glyphNumbers, offsets);
+
+		for (auto g : glyphNumbers)
+			getGlyph(g);
+	}
+}
+
+const mcl::GlyphAtlas::Entry& mcl::GlyphAtlas::getGlyph(int glyphNumber)
+{
+	if (!entries.contains(glyphNumber))
+		entries.set(glyphNumber, addGlyph(glyphNumber));
+
+	return entries.getReference(glyphNumber);
+}
+
+juce::int64 mcl::GlyphAtlas::getNumBytes() const
+{
+	return (int64)image.getWidth() * (int64)image.getHeight() * 4 + (int64)entries.size() * (int64)(sizeof(int) + sizeof(Entry));
+}
+
+void mcl::GlyphAtlas::clear()
+{
+	if (image.isNull())
+		image = Image(Image::ARGB, Size, Size, true);
+	else
+		image.clear(image.getBounds());
+
+	entries.clear();
+	cursor = {};
+	shelfHeight = 0;
+	generation++;
+	dirtyArea = image.getBounds();
+}
+
+mcl::GlyphAtlas::Entry mcl::GlyphAtlas::addGlyph(int glyphNumber)
+{
+	Entry e;
+
+	Path p;
+
+	if (auto tf = scaledFont.getTypeface())
+		tf->getOutlineForGlyph(glyphNumber, p);
+
+	p.applyTransform(AffineTransform::scale(scaledFont.getHeight() * scaledFont.getHorizontalScale(), scaledFont.getHeight()));
+
+	if (p.isEmpty())
+		return e;
+
+	// one pixel padding so that the linear filtering doesn't bleed into the neighbours
+	auto b = p.getBounds().getSmallestIntegerContainer().expanded(1);
+
+	if (b.getWidth() > Size || b.getHeight() > Size)
+		return e;
+
+	// simple shelf packing: a new shelf starts when the current one is full
+	if (cursor.x + b.getWidth() > Size)
+	{
+		cursor = { 0, cursor.y + shelfHeight };
+		shelfHeight = 0;
+	}
+
+	if (cursor.y + b.getHeight() > Size)
+	{
+		// The atlas is full, so it starts again with the glyphs that are requested from now on
+		clear();
+	}
+
+	e.area = b.withPosition(cursor);
+	e.offset = b.getPosition();
+
+	{
+		Graphics g(image);
+		g.reduceClipRegion(e.area);
+		g.setColour(Colours::white);
+		g.fillPath(p, AffineTransform::translation((float)(e.area.getX() - b.getX()), (float)(e.area.getY() - b.getY())));
+	}
+
+	cursor.x += b.getWidth();
+	shelfHeight = jmax(shelfHeight, b.getHeight());
+	dirtyArea = dirtyArea.isEmpty() ? e.area : dirtyArea.getUnion(e.area);
+
+	return e;
+}
+
+//==============================================================================
+mcl::GLTextRenderer::GLTextRenderer(TextEditor& parent_) :
+	parent(parent_)
+{
+	context.setRenderer(this);
+	context.setComponentPaintingEnabled(true);
+	context.attachTo(parent);
+}
+
+mcl::GLTextRenderer::~GLTextRenderer()
+{
+	context.detach();
+}
+
+void mcl::GLTextRenderer::newOpenGLContextCreated()
+{
+	if (!createShader())
+		shader = nullptr;
+
+	context.extensions.glGenBuffers(1, &vertexBuffer);
+}
+
+void mcl::GLTextRenderer::openGLContextClosing()
+{
+	positionAttribute = nullptr;
+	textureCoordAttribute = nullptr;
+	colourAttribute = nullptr;
+	screenSizeUniform = nullptr;
+	atlasUniform = nullptr;
+	shader = nullptr;
+
+	atlasTexture.release();
+
+	if (vertexBuffer != 0)
+		context.extensions.glDeleteBuffers(1, &vertexBuffer);
+
+	vertexBuffer = 0;
+}
+
+void mcl::GLTextRenderer::renderOpenGL()
+{
+	Profiler::ScopedTimer frame(Profiler::Frame);
+
+	auto scale = (float)context.getRenderingScale();
+
+	// The document and the view belong to the message thread. JUCE holds the message
+	// manager lock while it repaints the components of the context, so the snapshot
+	// is only updated in these frames. The other frames draw the last snapshot, so
+	// the renderer never waits for the message thread itself.
+	if (MessageManager::existsAndIsLockedByCurrentThread())
+		updateSnapshot(scale);
+
+	OpenGLHelpers::clear(snapshot.background);
+
+	if (snapshot.width <= 0 || snapshot.height <= 0)
+		return;
+
+	// the selections and search results are drawn with the JUCE renderer
+	{
+		std::unique_ptr<LowLevelGraphicsContext> glContext(createOpenGLGraphicsContext(context, snapshot.width, snapshot.height));
+		Graphics g(*glContext);
+		g.addTransform(AffineTransform::scale(snapshot.scale));
+		g.addTransform(snapshot.transform);
+		HighlightComponent::paintFrame(g, snapshot.highlight);
+	}
+
+	if (shader == nullptr)
+		return;
+
+	uploadAtlas();
+
+	drawVertices(snapshot.width, snapshot.height);
+}
+
+void mcl::GLTextRenderer::updateSnapshot(float scale)
+{
+	snapshot.background = parent.findColour(CodeEditorComponent::backgroundColourId);
+	snapshot.scale = scale;
+	snapshot.transform = parent.transform;
+	snapshot.width = roundToInt(scale * (float)parent.getWidth());
+	snapshot.height = roundToInt(scale * (float)parent.getHeight());
+	snapshot.highlight = parent.highlight.createFrame();
+
+	vertices.clearQuick();
+
+	if (snapshot.width <= 0 || snapshot.height <= 0)
+		return;
+
+	auto& document = parent.document;
+	auto visibleArea = parent.getLocalBounds().toFloat().transformedBy(parent.transform.inverted());
+
+	if (parent.enableSyntaxHighlighting)
+		parent.updateTokens(visibleArea);
+
+	Profiler::ScopedTimer st(Profiler::GlyphDraw);
+
+	// document space -> physical pixels
+	auto t = parent.transform.scaled(scale);
+
+	atlas.setFont(document.getFont(), parent.transform.getScaleFactor() * scale);
+
+	// If the atlas runs full while the quads are created, the texture coordinates of
+	// the glyphs before are invalid, so it starts again (this happens at most once)
+	arena.reset();
+
+	auto numTokens = parent.enableSyntaxHighlighting ? parent.colourScheme.types.size() : 1;
+	auto glyphs = document.collectGlyphsIntersecting(visibleArea, numTokens, arena);
+
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		auto generation = atlas.getGeneration();
+		vertices.clearQuick();
+
+		for (int n = 0; n < numTokens; ++n)
+		{
+			auto c = parent.enableSyntaxHighlighting ? parent.colourScheme.types[n].colour
+													 : parent.findColour(CodeEditorComponent::defaultTextColourId);
+
+			addGlyphs(glyphs.glyphs + glyphs.tokenStarts[n], glyphs.glyphs + glyphs.tokenStarts[n + 1], c, t);
+		}
+
+		if (generation == atlas.getGeneration())
+			break;
+	}
+}
+
+void mcl::GLTextRenderer::addGlyphs(const TextDocument::FrameGlyphs::Ref* begin, const TextDocument::FrameGlyphs::Ref* end, Colour c, const AffineTransform& t)
+{
+	auto pc = c.getPixelARGB();
+	pc.premultiply();
+
+	const float r = (float)pc.getRed() / 255.0f;
+	const float g = (float)pc.getGreen() / 255.0f;
+	const float b = (float)pc.getBlue() / 255.0f;
+	const float a = (float)pc.getAlpha() / 255.0f;
+
+	const auto invSize = 1.0f / (float)GlyphAtlas::Size;
+
+	for (auto ref = begin; ref != end; ++ref)
+	{
+		const auto& pg = *ref->glyph;
+		const auto& e = atlas.getGlyph(pg.getGlyphNumber());
+
+		if (e.area.isEmpty())
+			continue;
+
+		// the glyph origin is snapped to the pixel grid so the texels map 1:1 to the screen
+		auto origin = Point<float>(pg.getLeft() + ref->offset.x, pg.getBaselineY() + ref->offset.y).transformedBy(t);
+
+		auto x1 = std::round(origin.x) + (float)e.offset.x;
+		auto y1 = std::round(origin.y) + (float)e.offset.y;
+		auto x2 = x1 + (float)e.area.getWidth();
+		auto y2 = y1 + (float)e.area.getHeight();
+
+		// OpenGLTexture::loadImage() flips the image vertically
+		auto u1 = (float)e.area.getX() * invSize;
+		auto u2 = (float)e.area.getRight() * invSize;
+		auto v1 = 1.0f - (float)e.area.getY() * invSize;
+		auto v2 = 1.0f - (float)e.area.getBottom() * invSize;
+
+		Vertex tl = { x1, y1, u1, v1, r, g, b, a };
+		Vertex tr = { x2, y1, u2, v1, r, g, b, a };
+		Vertex bl = { x1, y2, u1, v2, r, g, b, a };
+		Vertex br = { x2, y2, u2, v2, r, g, b, a };
+
+		vertices.add(tl, tr, bl);
+		vertices.add(tr, br, bl);
+	}
+}
+
+bool mcl::GLTextRenderer::createShader()
+{
+	String vertexShader =
+		"attribute vec2 position;\n"
+		"attribute vec2 textureCoordIn;\n"
+		"attribute vec4 colourIn;\n"
+		"uniform vec2 screenSize;\n"
+		"varying vec2 textureCoordOut;\n"
+		"varying vec4 colourOut;\n"
+		"void main()\n"
+		"{\n"
+		"    textureCoordOut = textureCoordIn;\n"
+		"    colourOut = colourIn;\n"
+		"    gl_Position = vec4(position.x / screenSize.x * 2.0 - 1.0, 1.0 - position.y / screenSize.y * 2.0, 0.0, 1.0);\n"
+		"}\n";
+
+	String fragmentShader =
+		"varying " JUCE_MEDIUMP " vec2 textureCoordOut;\n"
+		"varying " JUCE_LOWP " vec4 colourOut;\n"
+		"uniform sampler2D atlasTexture;\n"
+		"void main()\n"
+		"{\n"
+		"    gl_FragColor = colourOut * texture2D(atlasTexture, textureCoordOut).a;\n"
+		"}\n";
+
+	shader.reset(new OpenGLShaderProgram(context));
+
+	if (!shader->addVertexShader(OpenGLHelpers::translateVertexShaderToV3(vertexShader)) ||
+		!shader->addFragmentShader(OpenGLHelpers::translateFragmentShaderToV3(fragmentShader)) ||
+		!shader->link())
+	{
+		DBG(shader->getLastError());
+		return false;
+	}
+
+	positionAttribute.reset(new OpenGLShaderProgram::Attribute(*shader, "position"));
+	textureCoordAttribute.reset(new OpenGLShaderProgram::Attribute(*shader, "textureCoordIn"));
+	colourAttribute.reset(new OpenGLShaderProgram::Attribute(*shader, "colourIn"));
+	screenSizeUniform.reset(new OpenGLShaderProgram::Uniform(*shader, "screenSize"));
+	atlasUniform.reset(new OpenGLShaderProgram::Uniform(*shader, "atlasTexture"));
+
+	return true;
+}
+
+void mcl::GLTextRenderer::uploadAtlas()
+{
+	auto dirtyArea = atlas.getAndClearDirtyArea();
+	const auto& image = atlas.getImage();
+
+	if (atlasTexture.getTextureID() == 0 || dirtyArea == image.getBounds())
+	{
+		atlasTexture.loadImage(image);
+		return;
+	}
+
+	if (dirtyArea.isEmpty())
+		return;
+
+	// New glyphs are added to the current shelf, so this is usually a small strip.
+	// OpenGLTexture::loadImage() flips the image vertically, so the rows are copied
+	// bottom up and the area is mirrored in the texture.
+	auto w = dirtyArea.getWidth();
+	auto h = dirtyArea.getHeight();
+
+	if (w * h > uploadBufferSize)
+	{
+		uploadBufferSize = w * h;
+		uploadBuffer.malloc(uploadBufferSize);
+	}
+
+	{
+		Image::BitmapData data(image, dirtyArea.getX(), dirtyArea.getY(), w, h, Image::BitmapData::readOnly);
+
+		for (int y = 0; y < h; y++)
+			memcpy(uploadBuffer + (h - 1 - y) * w, data.getLinePointer(y), (size_t)w * sizeof(PixelARGB));
+	}
+
+	// The glyphs are white, so every channel of a premultiplied pixel is its alpha and
+	// the byte order of the pixels doesn't matter (the shader only reads the alpha)
+	atlasTexture.bind();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, dirtyArea.getX(), image.getHeight() - dirtyArea.getBottom(), w, h,
+					GL_RGBA, GL_UNSIGNED_BYTE, uploadBuffer.get());
+	atlasTexture.unbind();
+}
+
+void mcl::GLTextRenderer::drawVertices(int width, int height)
+{
+	if (vertices.isEmpty())
+		return;
+
+	auto& ext = context.extensions;
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	ext.glActiveTexture(GL_TEXTURE0);
+	atlasTexture.bind();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	shader->use();
+	screenSizeUniform->set((GLfloat)width, (GLfloat)height);
+	atlasUniform->set(0);
+
+	ext.glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	ext.glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)((size_t)vertices.size() * sizeof(Vertex)), vertices.getRawDataPointer(), GL_STREAM_DRAW);
+
+	auto stride = (GLsizei)sizeof(Vertex);
+
+	ext.glVertexAttribPointer((GLuint)positionAttribute->attributeID, 2, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Vertex, x));
+	ext.glEnableVertexAttribArray((GLuint)positionAttribute->attributeID);
+	ext.glVertexAttribPointer((GLuint)textureCoordAttribute->attributeID, 2, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Vertex, u));
+	ext.glEnableVertexAttribArray((GLuint)textureCoordAttribute->attributeID);
+	ext.glVertexAttribPointer((GLuint)colourAttribute->attributeID, 4, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Vertex, r));
+	ext.glEnableVertexAttribArray((GLuint)colourAttribute->attributeID);
+
+	glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+
+	ext.glDisableVertexAttribArray((GLuint)positionAttribute->attributeID);
+	ext.glDisableVertexAttribArray((GLuint)textureCoordAttribute->attributeID);
+	ext.glDisableVertexAttribArray((GLuint)colourAttribute->attributeID);
+	ext.glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	atlasTexture.unbind();
+}
+
+juce::int64 mcl::GLTextRenderer::getNumBytes() const
+{
+	return atlas.getNumBytes() + MemoryUsage::getArrayBytes(vertices) + arena.getNumBytes() + (int64)uploadBufferSize * (int64)sizeof(PixelARGB);
+}
+
+#endif
+
+}
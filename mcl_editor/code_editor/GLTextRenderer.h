@@ -0,0 +1,166 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+#if MCL_ENABLE_OPEN_GL
+
+//==============================================================================
+/** Rasterises the glyphs of a font into a single image that is used as texture.
+
+	The glyphs are rendered in white at their physical pixel size, so they can be
+	drawn as textured quads that are tinted with the token colour. The printable
+	ASCII range is added when the font or the scale changes, every other glyph is
+	added when it's used for the first time.
+*/
+class GlyphAtlas
+{
+public:
+
+	struct Entry
+	{
+		Rectangle<int> area;	///< the position in the atlas image (empty for whitespace)
+		Point<int> offset;		///< the top left corner relative to the glyph origin in physical pixels
+	};
+
+	static constexpr int Size = 2048;
+
+	/** Sets the font and the scale (view zoom * display scale). This clears the atlas if one of them changed. */
+	void setFont(const Font& f, float scale);
+
+	/** Returns the entry for the glyph. This adds it to the atlas if necessary. */
+	const Entry& getGlyph(int glyphNumber);
+
+	const Image& getImage() const { return image; }
+
+	/** Changes whenever the atlas was cleared, so entries that were returned before are invalid. */
+	int getGeneration() const { return generation; }
+
+	/** Returns the area of the image that has changed since the last call. This is
+		the whole image after the atlas was cleared and empty if nothing was added.
+	*/
+	Rectangle<int> getAndClearDirtyArea()
+	{
+		auto d = dirtyArea;
+		dirtyArea = {};
+		return d;
+	}
+
+	int64 getNumBytes() const;
+
+private:
+
+	void clear();
+	Entry addGlyph(int glyphNumber);
+
+	Font font;
+	Font scaledFont;
+	float scale = 0.0f;
+
+	Image image;
+	HashMap<int, Entry> entries;
+
+	Point<int> cursor;
+	int shelfHeight = 0;
+	int generation = 0;
+	Rectangle<int> dirtyArea;
+};
+
+//==============================================================================
+/** An OpenGL renderer for the text of a TextEditor.
+
+	This attaches an OpenGLContext to the editor and draws the visible glyphs as
+	quads with a single draw call from a GlyphAtlas texture, so the cost of a frame
+	doesn't depend on the rasterisation of the text. The background and the
+	selection highlights are drawn with the JUCE OpenGL renderer, the child
+	components (gutter, caret, minimap) are composited as textured layers on top.
+
+	The document is only read in the frames in which JUCE repaints the components
+	(and holds the message manager lock anyway). These frames copy the quads and
+	the highlights into a snapshot, the other frames draw the last snapshot.
+
+	The renderer only needs OpenGL 2.1 / GLES 2 features, so it runs on software
+	implementations like Mesa llvmpipe.
+*/
+class GLTextRenderer : public OpenGLRenderer
+{
+public:
+
+	GLTextRenderer(TextEditor& parent);
+	~GLTextRenderer();
+
+	void newOpenGLContextCreated() override;
+	void renderOpenGL() override;
+	void openGLContextClosing() override;
+
+	int64 getNumBytes() const;
+
+private:
+
+	struct Vertex
+	{
+		float x, y;
+		float u, v;
+		float r, g, b, a;
+	};
+
+	/** The state of the editor that is needed to draw a frame. */
+	struct Snapshot
+	{
+		Colour background;
+		AffineTransform transform;
+		float scale = 1.0f;
+		int width = 0;
+		int height = 0;
+		HighlightComponent::Frame highlight;
+	};
+
+	/** Copies the visible glyphs (as quads) and the highlights. This requires the message manager lock. */
+	void updateSnapshot(float scale);
+
+	void addGlyphs(const TextDocument::FrameGlyphs::Ref* begin, const TextDocument::FrameGlyphs::Ref* end, Colour c, const AffineTransform& t);
+	bool createShader();
+
+	/** Uploads the parts of the atlas that have changed since the last frame. */
+	void uploadAtlas();
+
+	void drawVertices(int width, int height);
+
+	TextEditor& parent;
+
+	OpenGLContext context;
+	GlyphAtlas atlas;
+	OpenGLTexture atlasTexture;
+
+	std::unique_ptr<OpenGLShaderProgram> shader;
+	std::unique_ptr<OpenGLShaderProgram::Attribute> positionAttribute, textureCoordAttribute, colourAttribute;
+	std::unique_ptr<OpenGLShaderProgram::Uniform> screenSizeUniform, atlasUniform;
+
+	Snapshot snapshot;
+
+	HeapBlock<PixelARGB> uploadBuffer;
+	int uploadBufferSize = 0;
+
+	GLuint vertexBuffer = 0;
+	Array<Vertex> vertices;
+	FrameArena arena;
+
+	JUCE_DECLARE_NON_COPYABLE(GLTextRenderer);
+};
+
+#endif
+
+}
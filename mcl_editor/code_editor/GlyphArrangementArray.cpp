@@ -15,6 +15,89 @@ using namespace juce;
 
 
 
+//==============================================================================
+juce_wchar mcl::GlyphArrangementArray::getCharacter(int index, int column) const
+{
+	if (isPositiveAndBelow(index, lines.size()))
+	{
+		auto e = lines.getObjectPointerUnchecked(index);
+
+		if (isPositiveAndBelow(column, e->length))
+			return e->getCharacter(column);
+	}
+
+	return 0;
+}
+
+int mcl::GlyphArrangementArray::getLength(int index) const
+{
+	if (isPositiveAndBelow(index, lines.size()))
+		return lines.getObjectPointerUnchecked(index)->length;
+
+	return 0;
+}
+
+int mcl::GlyphArrangementArray::getMaximumLength() const
+{
+	if (maximumLength < 0)
+	{
+		maximumLength = 0;
+
+		for (auto l : lines)
+			maximumLength = jmax(maximumLength, l->length);
+	}
+
+	return maximumLength;
+}
+
+void mcl::GlyphArrangementArray::insertEntry(int index, Entry* e)
+{
+	index = jlimit(0, lines.size(), index);
+	lines.insert(index, e);
+	metadata.insert(index, e->length, font.getHeight());
+
+	if (maximumLength >= 0)
+		maximumLength = jmax(maximumLength, e->length);
+}
+
+//==============================================================================
+mcl::GlyphArrangementArray::Entry::Entry(const juce::String& string_) :
+	Entry(string_, LineScanner::scanLine(string_.toRawUTF8(), (int)string_.getNumBytesAsUTF8()))
+{
+}
+
+mcl::GlyphArrangementArray::Entry::Entry(const juce::String& string_, const LineScanner::Line& info) :
+	string(string_),
+	length(info.numCharacters),
+	isASCII(info.isASCII()),
+	hasTabs(info.hasTabs())
+{
+	jassert(length == string.length());
+
+	if (!isASCII)
+	{
+		characters.malloc(length);
+
+		auto p = string.getCharPointer();
+
+		for (int i = 0; i < length; i++)
+			characters[i] = p.getAndAdvance();
+	}
+
+	// the tokens must be available before the layout is created
+	tokens.insertMultiple(0, 0, length);
+}
+
+juce::String mcl::GlyphArrangementArray::Entry::getSubstring(Range<int> range) const
+{
+	range = range.getIntersectionWith({ 0, length });
+
+	if (isASCII)
+		return String(CharPointer_UTF8(string.toRawUTF8() + range.getStart()), (size_t)range.getLength());
+
+	return String(CharPointer_UTF32(characters + range.getStart()), (size_t)range.getLength());
+}
+
 //==============================================================================
 const String& mcl::GlyphArrangementArray::operator[] (int index) const
 {
@@ -66,7 +149,7 @@ void mcl::GlyphArrangementArray::applyTokens(int index, Selection zone)
 		entry->tokens.setUnchecked(col, zone.token);
 	}
 
-	entry->tokensAreDirty = false;
+	metadata.clearFlags(index, LineMetadata::TokensDirty);
 }
 
 GlyphArrangement mcl::GlyphArrangementArray::getGlyphs(int index,
@@ -84,16 +167,12 @@ GlyphArrangement mcl::GlyphArrangementArray::getGlyphs(int index,
 		}
 		return glyphs;
 	}
-	ensureValid(index);
-
-	auto entry = lines[index];
-	auto glyphSource = withTrailingSpace ? entry->glyphsWithTrailingSpace : entry->glyphs;
-	auto glyphs = GlyphArrangement();
-
-
 
 	if (DEBUG_TOKENS)
 	{
+		ensureValid(index);
+
+		auto entry = lines[index];
 		String line;
 		String hex("0123456789abcdefg");
 
@@ -103,108 +182,607 @@ GlyphArrangement mcl::GlyphArrangementArray::getGlyphs(int index,
 		if (withTrailingSpace)
 			line << " ";
 
-		glyphSource.clear();
-		glyphSource.addLineOfText(font, line, 0.f, 0.f);
+		GlyphArrangement debugGlyphs, glyphs;
+		debugGlyphs.addLineOfText(font, line, 0.f, 0.f);
+
+		for (int n = 0; n < debugGlyphs.getNumGlyphs(); ++n)
+		{
+			if (token == -1 || entry->tokens[n] == token)
+			{
+				auto glyph = debugGlyphs.getGlyph(n);
+				glyph.moveBy(TEXT_INDENT, baseline);
+				glyphs.addGlyph(glyph);
+			}
+		}
+
+		return glyphs;
 	}
 
+	GlyphArrangement glyphs;
+	for (int c = 0; c < getNumChunks(index); c++)
+		getGlyphRun(index, baseline, token, withTrailingSpace, c).addTo(glyphs);
+
+	return glyphs;
+}
 
+mcl::GlyphArrangementArray::GlyphRun mcl::GlyphArrangementArray::getGlyphRun(int index, float baseline, int token, bool withTrailingSpace, int chunk) const
+{
+	GlyphRun run;
+	run.token = token;
+	run.offset = { TEXT_INDENT, baseline };
 
-	for (int n = 0; n < glyphSource.getNumGlyphs(); ++n)
+	if (auto entry = lines.getObjectPointer(index))
 	{
-		if (token == -1 || entry->tokens.getUnchecked(n) == token)
+		const Layout* l;
+
+		if (isChunked(index))
 		{
-			auto glyph = glyphSource.getGlyph(n);
+			ensureValid(index);
 
+			// The chunks are placed at their column, so there's no kerning across the chunk boundaries
+			chunk = jlimit(0, getNumChunks(index) - 1, chunk);
+			l = &getChunk(entry, chunk);
+			run.firstColumn = chunk * ChunkSize;
+			run.offset.x += (float)run.firstColumn * characterRectangle.getWidth();
+		}
+		else
+		{
+			l = &getLayout(index);
+		}
 
+		auto& layout = *l;
 
-			glyph.moveBy(TEXT_INDENT, baseline);
+		// GlyphArrangement has no const access to its glyphs, but the run doesn't modify them
+		auto& source = const_cast<GlyphArrangement&>(layout.getGlyphs(withTrailingSpace));
 
-			glyphs.addGlyph(glyph);
-		}
+		run.numGlyphs = source.getNumGlyphs();
+		run.glyphs = run.numGlyphs > 0 ? &source.getGlyph(0) : nullptr;
+		run.tokens = &entry->tokens;
 	}
 
-	return glyphs;
+	return run;
 }
 
+bool mcl::GlyphArrangementArray::isFixedPitch(const Font& f)
+{
+	auto w = f.getStringWidthFloat("W");
+
+	for (auto c : { "i", " ", "." })
+	{
+		if (std::abs(f.getStringWidthFloat(c) - w) > 0.01f)
+			return false;
+	}
 
+	return true;
+}
 
-void mcl::GlyphArrangementArray::ensureValid(int index) const
+bool mcl::GlyphArrangementArray::isChunked(int index) const
+{
+	if (maxLineWidth != -1 || !fixedPitch || !isPositiveAndBelow(index, lines.size()))
+		return false;
+
+	// The chunks are placed at their first column, which is only valid if every
+	// character has the same advance (a tab glyph depends on the typeface)
+	auto entry = lines.getObjectPointerUnchecked(index);
+	return entry->length > MaxUnchunkedLength && !entry->hasTabs;
+}
+
+int mcl::GlyphArrangementArray::getNumChunks(int index) const
+{
+	if (!isChunked(index))
+		return 1;
+
+	return (lines.getObjectPointerUnchecked(index)->length + ChunkSize - 1) / ChunkSize;
+}
+
+Range<int> mcl::GlyphArrangementArray::getChunksIntersecting(int index, Range<float> xRange) const
+{
+	if (!isChunked(index))
+		return { 0, 1 };
+
+	auto numChunks = getNumChunks(index);
+	auto chunkWidth = (float)ChunkSize * characterRectangle.getWidth();
+
+	auto toChunk = [&](float x)
+	{
+		return jlimit(0.0f, (float)numChunks, (x - TEXT_INDENT) / chunkWidth);
+	};
+
+	auto first = (int)std::floor(toChunk(xRange.getStart()));
+	auto last = jmax(first, (int)std::ceil(toChunk(xRange.getEnd())));
+
+	return { first, last };
+}
+
+Array<Line<float>> mcl::GlyphArrangementArray::getUnderlines(int index, Range<int> columnRange, bool createFirstForEmpty) const
+{
+	if (!isChunked(index))
+		return getLayout(index).getUnderlines(columnRange, createFirstForEmpty);
+
+	// The same as Layout::getUnderlines() with a single row and every character in its column
+	Array<Line<float>> underlines;
+
+	if (!columnRange.isEmpty())
+	{
+		auto length = lines.getObjectPointerUnchecked(index)->length;
+		auto w = characterRectangle.getWidth();
+		auto l = (float)jmin(columnRange.getStart(), length - 1) * w;
+		auto r = (float)jmin(columnRange.getEnd(), length) * w;
+
+		underlines.add({ l, 0.0f, r, 0.0f });
+	}
+
+	return underlines;
+}
+
+bool mcl::GlyphArrangementArray::canSkipLayout(int index) const
+{
+	// Every character is a single column in a single row, but the advance of
+	// a tab glyph depends on the typeface, so those lines need the layout
+	return fixedPitch && maxLineWidth == -1 && !lines.getObjectPointerUnchecked(index)->hasTabs;
+}
+
+Point<int> mcl::GlyphArrangementArray::getPositionInLine(int index, int col, OutOfBoundsMode mode) const
 {
 	if (!isPositiveAndBelow(index, lines.size()))
-		return;
+		return {};
 
-	auto entry = lines[index];
+	if (!canSkipLayout(index))
+		return getLayout(index).getPositionInLine(col, mode);
+
+	// The same as Layout::getPositionInLine() with the positions { 0, i } and a single line
+	auto length = lines.getObjectPointerUnchecked(index)->length;
+
+	if (isPositiveAndBelow(col, length))
+		return { 0, col };
+
+	switch (mode)
+	{
+	case ReturnLastCharacter:		return { 0, jmax(0, length - 1) };
+	case ReturnNextLine:			return { 1, 0 };
+	case ReturnBeyondLastCharacter: return { 0, length };
+	default:						jassertfalse; return {};
+	}
+}
+
+int mcl::GlyphArrangementArray::getGlyphIndexAt(int index, int wrappedLine, int column) const
+{
+	if (!isPositiveAndBelow(index, lines.size()))
+		return 0;
+
+	auto length = lines.getObjectPointerUnchecked(index)->length;
+
+	// the glyphs with the trailing space have one more glyph if the line is wrapped
+	auto lastGlyph = jmax(0, maxLineWidth != -1 ? length : length - 1);
+
+	if (canSkipLayout(index))
+		return (wrappedLine == 0 && isPositiveAndBelow(column, length)) ? column : lastGlyph;
+
+	const auto& positions = getLayout(index).getPositions();
+	Point<int> target(wrappedLine, column);
+
+	// the positions are sorted by the wrapped line and then the column
+	auto it = std::lower_bound(positions.begin(), positions.end(), target, [](Point<int> a, Point<int> b)
+	{
+		return a.x < b.x || (a.x == b.x && a.y < b.y);
+	});
+
+	auto n = (int)(it - positions.begin());
+
+	if (n < positions.size() && positions[n] == target)
+		return n;
+
+	// the column is within a glyph that is wider than a single column (eg. a tab)
+	if (n > 0 && n < positions.size() && positions[n - 1].x == wrappedLine && positions[n].x == wrappedLine)
+		return n - 1;
+
+	return lastGlyph;
+}
+
+void mcl::GlyphArrangementArray::GlyphRun::draw(Graphics& g) const
+{
+	auto t = AffineTransform::translation(offset.x, offset.y);
+
+	for (const auto& glyph : *this)
+		glyph.draw(g, t);
+}
 
-	if (entry->glyphsAreDirty)
+void mcl::GlyphArrangementArray::GlyphRun::addTo(GlyphArrangement& target) const
+{
+	for (auto glyph : *this)
 	{
-		//entry.string = Helpers::replaceTabsWithSpaces(entry.string, 4);
+		glyph.moveBy(offset.x, offset.y);
+		target.addGlyph(glyph);
+	}
+}
 
-		auto toDraw = entry->string;// ;
 
-		entry->tokens.resize(toDraw.length());
-		entry->glyphs.clear();
-		entry->glyphsWithTrailingSpace.clear();
 
+void mcl::GlyphArrangementArray::addMemoryUsage(MemoryUsage& m) const
+{
+	// The layouts can be shared between lines, so every layout is only counted once
+	SortedSet<const Layout*> layouts;
+
+	for (auto l : lines)
+	{
+		l->addMemoryUsage(m);
 
+		if (l->layout != nullptr)
+			layouts.add(l->layout.get());
 
-		if (maxLineWidth != -1)
+		for (auto c : l->chunks)
 		{
-			entry->glyphs.addJustifiedText(font, toDraw, 0.f, 0.f, maxLineWidth, Justification::centredLeft);
-			entry->glyphsWithTrailingSpace.addJustifiedText(font, toDraw + " ", 0.f, 0.f, maxLineWidth, Justification::centredLeft);
+			if (c != nullptr)
+				layouts.add(c.get());
 		}
-		else
+	}
+
+	for (auto l : layouts)
+		m.add(MemoryUsage::Glyphs, l->getNumBytes());
+
+	m.add(MemoryUsage::Glyphs, (int64)lines.size() * (int64)sizeof(Entry*) + metadata.getNumBytes());
+}
+
+const mcl::GlyphArrangementArray::Layout& mcl::GlyphArrangementArray::getLayout(int index) const
+{
+	if (auto e = lines.getObjectPointer(index))
+	{
+		ensureValid(index);
+		return e->getLayout();
+	}
+
+	static const Layout empty;
+	return empty;
+}
+
+void mcl::GlyphArrangementArray::releaseLayoutsOutside(Range<int> visibleLines)
+{
+	Range<int> allLines(0, lines.size());
+
+	auto linesToKeep = allLines.getIntersectionWith({ visibleLines.getStart() - NumLinesToKeepLayouts,
+													  visibleLines.getEnd() + NumLinesToKeepLayouts });
+
+	auto release = [&](Range<int> r)
+	{
+		r = r.getIntersectionWith(allLines);
+
+		for (int i = r.getStart(); i < r.getEnd(); i++)
 		{
-			entry->glyphs.addLineOfText(font, toDraw, 0.f, 0.f);
-			entry->glyphsWithTrailingSpace.addLineOfText(font, toDraw, 0.f, 0.f);
+			auto entry = lines.getObjectPointerUnchecked(i);
+
+			entry->chunks.clear();
+
+			// Without line breaks the height of a line doesn't need the layout
+			if (maxLineWidth == -1 && entry->layout != nullptr)
+			{
+				entry->layout = nullptr;
+				metadata.setFlags(i, LineMetadata::GlyphsDirty);
+			}
 		}
+	};
 
+	release({ linesWithLayouts.getStart(), jmin(linesWithLayouts.getEnd(), linesToKeep.getStart()) });
+	release({ jmax(linesWithLayouts.getStart(), linesToKeep.getEnd()), linesWithLayouts.getEnd() });
 
+	linesWithLayouts = linesToKeep;
+}
+
+void mcl::GlyphArrangementArray::setMaxLineWidth(int newMaxLineWidth)
+{
+	if (newMaxLineWidth == maxLineWidth)
+		return;
+
+	maxLineWidth = newMaxLineWidth;
 
-		entry->positions.clearQuick();
-		entry->positions.ensureStorageAllocated(entry->string.length());
-		entry->characterBounds = characterRectangle;
-		auto n = entry->glyphs.getNumGlyphs();
-		auto first = entry->glyphsWithTrailingSpace.getBoundingBox(0, 1, true);
+	for (int i = 0; i < metadata.flags.size(); i++)
+		metadata.setFlags(i, LineMetadata::WidthChanged);
+}
 
+void mcl::GlyphArrangementArray::ensureValid(int index) const
+{
+	if (!isPositiveAndBelow(index, lines.size()))
+		return;
 
-		for (int i = 0; i < n; i++)
+	if (isChunked(index))
+	{
+		auto entry = lines.getObjectPointerUnchecked(index);
+
+		if (metadata.hasFlag(index, LineMetadata::GlyphsDirty))
+			entry->chunks.clearQuick();
+
+		if (metadata.hasFlag(index, (uint8)(LineMetadata::GlyphsDirty | LineMetadata::WidthChanged)))
 		{
-			auto box = entry->glyphs.getBoundingBox(i, 1, true);
-			box = box.translated(-first.getX(), -first.getY());
+			// The chunks are shaped when they are painted, the line is a single row
+			entry->layout = nullptr;
 
-			float x = box.getY() / characterRectangle.getHeight();
-			float y = box.getX() / characterRectangle.getWidth();
+			metadata.heights.set(index, font.getHeight());
+			metadata.numColumns.set(index, entry->length);
+			metadata.clearFlags(index, LineMetadata::WidthChanged);
 
-			entry->positions.add({ roundToInt(x), roundToInt(y) });
+			if (cacheGlyphArrangement)
+				metadata.clearFlags(index, LineMetadata::GlyphsDirty);
 		}
 
-		entry->charactersPerLine.clear();
+		return;
+	}
+
+	if (metadata.hasFlag(index, LineMetadata::GlyphsDirty))
+	{
+		Profiler::ScopedTimer st(Profiler::Layout);
+		updateGlyphs(lines.getObjectPointerUnchecked(index));
+		updateMetadata(index);
+	}
+	else if (metadata.hasFlag(index, LineMetadata::WidthChanged))
+	{
+		Profiler::ScopedTimer st(Profiler::Layout);
+		rewrapGlyphs(lines.getObjectPointerUnchecked(index));
+		updateMetadata(index);
+	}
+}
+
+void mcl::GlyphArrangementArray::updateMetadata(int index) const
+{
+	auto& layout = lines.getObjectPointerUnchecked(index)->getLayout();
+
+	int numColumns = 0;
+
+	for (auto c : layout.charactersPerLine)
+		numColumns = jmax(numColumns, c);
+
+	metadata.heights.set(index, layout.height);
+	metadata.numColumns.set(index, numColumns);
+	metadata.clearFlags(index, LineMetadata::WidthChanged);
+
+	if (cacheGlyphArrangement)
+		metadata.clearFlags(index, LineMetadata::GlyphsDirty);
+}
+
+void mcl::GlyphArrangementArray::updateGlyphs(Entry* entry) const
+{
+	//entry.string = Helpers::replaceTabsWithSpaces(entry.string, 4);
+
+	entry->tokens.resize(entry->length);
+	entry->chunks.clear();
+	entry->layout = createLayout(entry->string);
+}
+
+mcl::GlyphArrangementArray::Layout::Ptr mcl::GlyphArrangementArray::createLayout(const String& toDraw) const
+{
+	auto key = LayoutCache::createKey(toDraw, font, maxLineWidth);
+	Layout::Ptr layout;
+
+	if (cacheGlyphArrangement)
+		layout = layoutCache->get(key, toDraw, maxLineWidth);
+
+	if (layout == nullptr)
+	{
+		layout = new Layout();
+		layout->string = toDraw;
+
+		// This is the only place where the text is shaped, everything else
+		// just copies and moves the glyphs around.
+		layout->shaped = new ShapedText(font, toDraw);
+
+		wrapGlyphs(*layout);
+
+		if (cacheGlyphArrangement)
+			layoutCache->add(key, layout);
+	}
+
+	return layout;
+}
+
+const mcl::GlyphArrangementArray::Layout& mcl::GlyphArrangementArray::getChunk(Entry* entry, int chunk) const
+{
+	auto numChunks = (entry->length + ChunkSize - 1) / ChunkSize;
+	jassert(isPositiveAndBelow(chunk, numChunks));
+
+	if (entry->chunks.size() != numChunks)
+	{
+		entry->chunks.clearQuick();
+		entry->chunks.insertMultiple(0, nullptr, numChunks);
+	}
+
+	auto& layout = entry->chunks.getReference(chunk);
+
+	if (layout == nullptr)
+	{
+		Profiler::ScopedTimer st(Profiler::Layout);
+
+		auto start = chunk * ChunkSize;
+		layout = createLayout(entry->getSubstring({ start, start + ChunkSize }));
+	}
+
+	return *layout;
+}
+
+void mcl::GlyphArrangementArray::rewrapGlyphs(Entry* entry) const
+{
+	// The line was chunked before, so there are no glyphs for the whole line yet
+	if (entry->layout == nullptr)
+	{
+		updateGlyphs(entry);
+		return;
+	}
+
+	auto key = LayoutCache::createKey(entry->string, font, maxLineWidth);
+
+	if (auto layout = layoutCache->get(key, entry->string, maxLineWidth))
+	{
+		entry->layout = layout;
+		return;
+	}
+
+	// The shared layout can't be changed, so we need a new one with the same glyphs
+	Layout::Ptr layout = new Layout();
+	layout->string = entry->string;
+	layout->shaped = entry->layout->shaped;
+
+	wrapGlyphs(*layout);
+
+	layoutCache->add(key, layout);
+	entry->layout = layout;
+}
+
+void mcl::GlyphArrangementArray::wrapGlyphs(Layout& layout) const
+{
+	const auto& shaped = *layout.shaped;
+	auto numGlyphs = shaped.advances.size();
+
+	layout.rowStarts.clearQuick();
+	layout.rowStarts.add(0);
 
-		int index = 0;
+	auto isNewLine = [&shaped](int i) { return shaped.types[i] >= ShapedText::CarriageReturn; };
 
-		for (const auto& p : entry->positions)
+	if (maxLineWidth != -1)
+	{
+		// Same line breaking as GlyphArrangement::addJustifiedText(), but it only adds up
+		// the advances of the shaped glyphs instead of creating them again for every width.
+		auto lineStart = 0;
+
+		while (lineStart < numGlyphs)
 		{
-			auto l = p.x;
-			auto characterIsTab = entry->string[index++] == '\t';
-			auto c = p.y + 1;
+			auto i = lineStart;
+			auto x = 0.0f;
 
-			if (isPositiveAndBelow(l, entry->charactersPerLine.size()))
-			{
-				auto& thisC = entry->charactersPerLine.getReference(l);
-				thisC = jmax(thisC, c);
-			}
-			else
+			if (!isNewLine(i))
+				x += shaped.advances[i++];
+
+			auto lastWordBreak = -1;
+
+			while (i < numGlyphs)
 			{
-				entry->charactersPerLine.set(l, c);
+				auto type = shaped.types[i];
+
+				if (isNewLine(i))
+				{
+					i++;
+
+					if (type == ShapedText::CarriageReturn && i < numGlyphs && shaped.types[i] == ShapedText::LineFeed)
+						i++;
+
+					break;
+				}
+
+				if (type == ShapedText::Whitespace)
+					lastWordBreak = i + 1;
+				else if (x + shaped.advances[i] - 0.0001f >= (float)maxLineWidth)
+				{
+					if (lastWordBreak >= 0)
+						i = lastWordBreak;
+
+					break;
+				}
+
+				x += shaped.advances[i++];
 			}
+
+			lineStart = i;
+
+			if (lineStart < numGlyphs)
+				layout.rowStarts.add(lineStart);
 		}
+	}
+
+	// The number of columns of every row (without the trailing space)
+	layout.charactersPerLine.clearQuick();
+
+	auto numCharacters = numGlyphs - 1;
+	auto charWidth = characterRectangle.getWidth();
+
+	for (int row = 0; row < layout.rowStarts.size(); row++)
+	{
+		auto start = layout.rowStarts[row];
+		auto end = jmin(numCharacters, row + 1 < layout.rowStarts.size() ? layout.rowStarts[row + 1] : numGlyphs);
+
+		if (start >= end)
+			break;
 
-		if (entry->charactersPerLine.isEmpty())
-			entry->charactersPerLine.add(0);
+		auto x = 0.0f;
 
-		entry->glyphsAreDirty = !cacheGlyphArrangement;
-		entry->height = font.getHeight() * (float)entry->charactersPerLine.size();
+		for (int i = start; i < end - 1; i++)
+			x += shaped.advances[i];
+
+		layout.charactersPerLine.add(roundToInt(x / charWidth) + 1);
 	}
+
+	if (layout.charactersPerLine.isEmpty())
+		layout.charactersPerLine.add(0);
+
+	layout.characterBounds = characterRectangle;
+	layout.rowHeight = font.getHeight();
+	layout.maxColumns = maxLineWidth;
+	layout.height = font.getHeight() * (float)layout.charactersPerLine.size();
+}
+
+//==============================================================================
+mcl::GlyphArrangementArray::ShapedText::ShapedText(const Font& font, const String& text)
+{
+	glyphs.addLineOfText(font, text + " ", 0.f, 0.f);
+
+	auto numGlyphs = glyphs.getNumGlyphs();
+	advances.ensureStorageAllocated(numGlyphs);
+	types.ensureStorageAllocated(numGlyphs);
+
+	for (int i = 0; i < numGlyphs; i++)
+	{
+		const auto& g = glyphs.getGlyph(i);
+		auto c = g.getCharacter();
+
+		advances.add(g.getRight() - g.getLeft());
+
+		if (c == '\r')
+			types.add(CarriageReturn);
+		else if (c == '\n')
+			types.add(LineFeed);
+		else
+			types.add(g.isWhitespace() ? Whitespace : Character);
+	}
+}
+
+void mcl::GlyphArrangementArray::Layout::ensureGlyphsArePlaced() const
+{
+	if (glyphsArePlaced || shaped == nullptr)
+		return;
+
+	glyphsArePlaced = true;
+
+	auto& wrapped = glyphsWithTrailingSpace;
+	wrapped = shaped->glyphs;
+
+	auto numGlyphs = wrapped.getNumGlyphs();
+	auto numCharacters = jmax(0, numGlyphs - 1);
+
+	positions.clearQuick();
+	positions.ensureStorageAllocated(numCharacters);
+
+	for (int row = 0; row < rowStarts.size(); row++)
+	{
+		auto start = rowStarts[row];
+		auto end = row + 1 < rowStarts.size() ? rowStarts[row + 1] : numGlyphs;
+
+		if (row > 0 && end > start)
+			wrapped.moveRangeOfGlyphs(start, end - start, -wrapped.getGlyph(start).getLeft(), (float)row * rowHeight);
+
+		// the columns are the offsets from the row start in character widths
+		auto x = 0.0f;
+
+		for (int i = start; i < jmin(end, numCharacters); i++)
+		{
+			positions.add({ row, roundToInt(x / characterBounds.getWidth()) });
+			x += shaped->advances[i];
+		}
+	}
+
+	// The trailing space doesn't change the line breaks before it, so the glyphs
+	// without the space are just the wrapped glyphs minus the last one.
+	glyphs = wrapped;
+
+	if (numGlyphs > 0)
+		glyphs.removeRangeOfGlyphs(numGlyphs - 1, 1);
+
+	if (maxColumns == -1)
+		wrapped = glyphs;
 }
 
 
@@ -215,19 +793,134 @@ void mcl::GlyphArrangementArray::invalidate(Range<int> lineRange)
 		lineRange = { 0, lines.size() };
 	}
 
+	// The layouts are created lazily when the lines are accessed, so without line
+	// breaks only the visible lines will be shaped
 	for (int i = lineRange.getStart(); i < lineRange.getEnd() + 1; i++)
 	{
 		if (isPositiveAndBelow(i, lines.size()))
-		{
-			lines[i]->tokensAreDirty = true;
-			lines[i]->glyphsAreDirty = true;
-		}
+			metadata.setFlags(i, (uint8)(LineMetadata::GlyphsDirty | LineMetadata::TokensDirty));
 	}
+}
+
+//==============================================================================
+void mcl::GlyphArrangementArray::LineMetadata::insert(int index, int numCharacters, float fontHeight)
+{
+	heights.insert(index, fontHeight);
+	numColumns.insert(index, numCharacters);
+	ids.insert(index, createId());
+	flags.insert(index, (uint8)(GlyphsDirty | TokensDirty));
+}
+
+void mcl::GlyphArrangementArray::LineMetadata::removeRange(int startIndex, int numToRemove)
+{
+	heights.removeRange(startIndex, numToRemove);
+	numColumns.removeRange(startIndex, numToRemove);
+	ids.removeRange(startIndex, numToRemove);
+	flags.removeRange(startIndex, numToRemove);
+}
+
+void mcl::GlyphArrangementArray::LineMetadata::clear()
+{
+	heights.clearQuick();
+	numColumns.clearQuick();
+	ids.clearQuick();
+	flags.clearQuick();
+}
 
-	for (int i = 0; i < lines.size(); i++)
-		ensureValid(i);
+juce::int64 mcl::GlyphArrangementArray::LineMetadata::getNumBytes() const
+{
+	return MemoryUsage::getArrayBytes(heights) + MemoryUsage::getArrayBytes(numColumns) +
+		   MemoryUsage::getArrayBytes(ids) + MemoryUsage::getArrayBytes(flags);
 }
 
 
 
+//==============================================================================
+juce::int64 mcl::GlyphArrangementArray::LayoutCache::createKey(const String& text, const Font& font, int maxLineWidth)
+{
+	uint64 h = 14695981039346656037ull;
+
+	auto add = [&h](uint64 v) { h = (h ^ v) * 1099511628211ull; };
+	auto addFloat = [&add](float v) { add((uint64)roundToInt(v * 1000.0f)); };
+
+	add((uint64)text.hashCode64());
+	add((uint64)font.getTypefaceName().hashCode64());
+	add((uint64)font.getTypefaceStyle().hashCode64());
+	addFloat(font.getHeight());
+	addFloat(font.getHorizontalScale());
+	addFloat(font.getExtraKerningFactor());
+	add((uint64)maxLineWidth);
+
+	return (int64)h;
+}
+
+mcl::GlyphArrangementArray::Layout::Ptr mcl::GlyphArrangementArray::LayoutCache::get(int64 key, const String& text, int maxLineWidth)
+{
+	if (!items.contains(key))
+		return nullptr;
+
+	auto item = items[key];
+
+	// a hash collision
+	if (item.layout->maxColumns != maxLineWidth || item.layout->string != text)
+		return nullptr;
+
+	item.lastUsed = ++counter;
+	items.set(key, item);
+
+	return item.layout;
+}
+
+void mcl::GlyphArrangementArray::LayoutCache::add(int64 key, Layout::Ptr layout)
+{
+	Item item;
+	item.layout = layout;
+	item.lastUsed = ++counter;
+	items.set(key, item);
+
+	if (items.size() > sweepThreshold)
+		removeUnusedLayouts();
+}
+
+void mcl::GlyphArrangementArray::LayoutCache::clear()
+{
+	items.clear();
+	sweepThreshold = MaxNumLayouts;
+}
+
+void mcl::GlyphArrangementArray::LayoutCache::removeUnusedLayouts()
+{
+	struct Candidate
+	{
+		int64 key;
+		uint32 lastUsed;
+	};
+
+	Array<Candidate> candidates;
+
+	for (HashMap<int64, Item>::Iterator i(items); i.next();)
+	{
+		// only the cache holds a reference to this layout
+		if (i.getValue().layout->getReferenceCount() == 1)
+			candidates.add({ i.getKey(), i.getValue().lastUsed });
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+	{
+		return a.lastUsed < b.lastUsed;
+	});
+
+	// Remove a quarter more than necessary so this doesn't run after every new layout
+	auto numToRemove = jmin(candidates.size(), items.size() - MaxNumLayouts * 3 / 4);
+
+	for (int i = 0; i < numToRemove; i++)
+		items.remove(candidates[i].key);
+
+	// The layouts that are used by a line can't be removed, so if the lines use more
+	// than MaxNumLayouts, the next sweep waits until the cache has grown by a quarter.
+	// This keeps the cost of the sweeps linear in the number of added layouts.
+	sweepThreshold = jmax(MaxNumLayouts, items.size() + items.size() / 4);
+}
+
+
 }
\ No newline at end of file
@@ -35,61 +35,248 @@ public:
 		numOutOfBoundsModes
 	};
 
+	/** Lines that are longer than this are split into chunks of ChunkSize characters if they are
+		not wrapped, the font is monospaced and they don't contain tabs. Every chunk has its own
+		layout that is only created when it's painted, so a single line of a minified file doesn't
+		have to be shaped at once. The other long lines are shaped as a whole.
+	*/
+	static constexpr int MaxUnchunkedLength = 4096;
+	static constexpr int ChunkSize = 1024;
+
 	int size() const { return lines.size(); }
-	void clear() { lines.clear(); }
+	void clear() { lines.clear(); metadata.clear(); maximumLength = 0; linesWithLayouts = {}; }
 	void add(const juce::String& string)
 	{
-		auto hash = Entry::createHash(string, maxLineWidth);
-		int lineNumber = lines.size();
-		auto cachedItem = cache.getCachedItem(lineNumber, hash);
+		insert(lines.size(), string);
+	}
 
-		if (cachedItem == nullptr)
-		{
-			cachedItem = new Entry(string, maxLineWidth);
-			cache.cachedItems.set(lineNumber, { hash, cachedItem });
-		}
+	/** Adds a line with the statistics from a LineScanner, so the text isn't scanned again. */
+	void add(const juce::String& string, const LineScanner::Line& info)
+	{
+		insertEntry(lines.size(), new Entry(string, info));
+	}
 
-		lines.add(cachedItem);
+	void insert(int index, const juce::String& string)
+	{
+		insertEntry(index, new Entry(string));
+	}
+
+	void removeRange(int startIndex, int numberToRemove)
+	{
+		lines.removeRange(startIndex, numberToRemove);
+		metadata.removeRange(startIndex, numberToRemove);
+
+		// the longest line might have been removed
+		maximumLength = -1;
 	}
 
-	void removeRange(int startIndex, int numberToRemove) { lines.removeRange(startIndex, numberToRemove); }
 	const juce::String& operator[] (int index) const;
 
+	/** Returns the character in the line, or 0 if the index is out of range. This is O(1). */
+	juce_wchar getCharacter(int index, int column) const;
+
+	/** Returns the number of characters in the line. This is O(1). */
+	int getLength(int index) const;
+
+	/** Returns the number of characters in the longest line. This is cached until a line is removed. */
+	int getMaximumLength() const;
+
+	/** Returns the height of the line. Without line breaks, every line has a single row,
+		so this doesn't need to create the layout.
+	*/
+	float getHeight(int index) const
+	{
+		if (maxLineWidth != -1)
+			ensureValid(index);
+
+		return metadata.heights[index];
+	}
+
+	/** Returns the number of characters in the longest row of the line. If the line wasn't
+		laid out yet, this is the length of the string.
+	*/
+	int getWidthInColumns(int index) const { return metadata.numColumns[index]; }
+
+	/** Returns a number that changes when the line at the index is replaced. */
+	uint32 getId(int index) const { return metadata.ids[index]; }
+
 
 	int getToken(int row, int col, int defaultIfOutOfBounds) const;
 	void clearTokens(int index);
 	void applyTokens(int index, Selection zone);
+
+	/** Returns a copy of the glyphs of the line (moved to the baseline). Use getGlyphRun() if you
+		just need to paint or hit test the glyphs.
+	*/
 	juce::GlyphArrangement getGlyphs(int index,
 		float baseline,
 		int token,
 		bool withTrailingSpace = false) const;
 
-	struct Entry : public ReferenceCountedObject
+	/** A view of the glyphs of a line with an offset and an optional token filter.
+
+		This points to the glyphs of the line layout, so it's only valid until the line or
+		its layout changes. Iterating over it skips the glyphs that don't match the token.
+	*/
+	struct GlyphRun
 	{
-		using Ptr = ReferenceCountedObjectPtr<Entry>;
+		struct Iterator
+		{
+			Iterator& operator++() { index = run->getNextIndex(index + 1); return *this; }
+			bool operator!=(const Iterator& other) const { return index != other.index; }
+			const PositionedGlyph& operator*() const { return run->glyphs[index]; }
+
+			/** The index of the glyph in the run (add firstColumn to get the column in the line). */
+			int getIndex() const { return index; }
+
+			const GlyphRun* run;
+			int index;
+		};
+
+		Iterator begin() const { return { this, getNextIndex(0) }; }
+		Iterator end() const { return { this, numGlyphs }; }
+
+		/** Returns the number of glyphs (regardless of the token). */
+		int size() const { return numGlyphs; }
+
+		/** Returns the glyph without the offset. */
+		const PositionedGlyph& getGlyph(int index) const { return glyphs[index]; }
+
+		/** Returns the bounds of the glyph with the offset. */
+		Rectangle<float> getBounds(int index) const { return glyphs[index].getBounds().translated(offset.x, offset.y); }
+
+		/** Returns the token of the glyph. */
+		int getToken(int index) const { return (*tokens)[firstColumn + index]; }
+
+		bool matches(int index) const { return token == -1 || (tokens != nullptr && getToken(index) == token); }
+
+		/** Draws the matching glyphs. */
+		void draw(Graphics& g) const;
+
+		/** Adds a copy of the matching glyphs with the offset to the arrangement. */
+		void addTo(GlyphArrangement& target) const;
+
+		const PositionedGlyph* glyphs = nullptr;
+		int numGlyphs = 0;
+		const Array<int>* tokens = nullptr;
+		int token = -1;
+		int firstColumn = 0;
+		Point<float> offset;
+
+	private:
+
+		int getNextIndex(int index) const
+		{
+			while (index < numGlyphs && !matches(index))
+				index++;
+
+			return index;
+		}
+	};
+
+	/** Returns a view of the glyphs of the line moved to the baseline. If the line is chunked, this
+		only contains the glyphs of the given chunk.
+	*/
+	GlyphRun getGlyphRun(int index, float baseline, int token, bool withTrailingSpace = false, int chunk = 0) const;
+
+	/** Returns true if the line is split into chunks (see MaxUnchunkedLength). */
+	bool isChunked(int index) const;
+
+	/** Returns the number of chunks of the line (1 if it's not chunked). */
+	int getNumChunks(int index) const;
+
+	/** Returns the range of chunks that intersect the horizontal range (in document coordinates).
+		If the line is not chunked, this is always { 0, 1 }.
+	*/
+	Range<int> getChunksIntersecting(int index, Range<float> xRange) const;
+
+	/** Returns the underlines of the column range relative to the top left of the line. */
+	Array<Line<float>> getUnderlines(int index, Range<int> columnRange, bool createFirstForEmpty) const;
+
+	/** Returns true if all characters of the font have the same advance. */
+	static bool isFixedPitch(const Font& f);
+
+	/** Returns the wrapped line and the column of the character in the line. If the font is fixed
+		pitch, the line is not wrapped and doesn't contain tabs, this is calculated from the
+		column without creating the layout.
+	*/
+	Point<int> getPositionInLine(int index, int col, OutOfBoundsMode mode) const;
+
+	/** Returns the index of the glyph (with the trailing space) at the wrapped line and the column
+		of a fixed pitch layout, or the last glyph if there is no glyph at this position.
+
+		This is the arithmetic version of testing the bounds of every glyph in the line.
+	*/
+	int getGlyphIndexAt(int index, int wrappedLine, int column) const;
+
+	/** The unwrapped glyphs of a string with a trailing space and their advances.
+
+		They are only created when the text or the font changes and are shared by the
+		layouts of the same text with different line widths.
+	*/
+	struct ShapedText : public ReferenceCountedObject
+	{
+		using Ptr = ReferenceCountedObjectPtr<ShapedText>;
+
+		enum GlyphType : uint8
+		{
+			Character,
+			Whitespace,
+			CarriageReturn,
+			LineFeed
+		};
+
+		ShapedText(const Font& font, const String& text);
+
+		int64 getNumBytes() const
+		{
+			return (int64)sizeof(ShapedText) +
+				   MemoryUsage::getGlyphArrangementBytes(glyphs) +
+				   MemoryUsage::getArrayBytes(advances) +
+				   MemoryUsage::getArrayBytes(types);
+		}
 
-		Entry() {}
-		Entry(const juce::String& string, int maxLineWidth) : string(string), maxColumns(maxLineWidth) {}
-		juce::String string;
-		juce::GlyphArrangement glyphsWithTrailingSpace;
 		juce::GlyphArrangement glyphs;
-		juce::Array<int> tokens;
-		bool glyphsAreDirty = true;
-		bool tokensAreDirty = true;
+		Array<float> advances;
+		Array<uint8> types;
+	};
+
+	/** The glyphs and the character positions of a line of text with a given font and line width.
 
-		Array<Point<int>> positions;
+		A Layout doesn't depend on the line index, so it is shared between all lines (and editors)
+		that have the same text, see LayoutCache. The rows are calculated from the advances of the
+		shaped text when the layout is created (see wrapGlyphs()), but the glyphs are only copied and
+		moved to their rows when the line is drawn or hit tested. Apart from that, a layout must not
+		be changed once it was added to the cache.
+	*/
+	struct Layout : public ReferenceCountedObject,
+					public MemoryUsage::Tracked<MemoryUsage::Glyphs>
+	{
+		using Ptr = ReferenceCountedObjectPtr<Layout>;
 
-		static int64 createHash(const String& text, int maxCharacters)
+		juce::String string;
+
+		ShapedText::Ptr shaped;
+
+		/** The index of the first glyph of every row. */
+		Array<int> rowStarts;
+
+		/** Copies the shaped glyphs into their rows and calculates the character positions. */
+		void ensureGlyphsArePlaced() const;
+
+		const juce::GlyphArrangement& getGlyphs(bool withTrailingSpace) const
 		{
-			return text.hashCode64() + (int64)maxCharacters;
+			ensureGlyphsArePlaced();
+			return withTrailingSpace ? glyphsWithTrailingSpace : glyphs;
 		}
 
-		int64 getHash() const
+		const Array<Point<int>>& getPositions() const
 		{
-			return createHash(string, maxColumns);
+			ensureGlyphsArePlaced();
+			return positions;
 		}
 
-		Array<Line<float>> getUnderlines(Range<int> columnRange, bool createFirstForEmpty)
+		Array<Line<float>> getUnderlines(Range<int> columnRange, bool createFirstForEmpty) const
 		{
 			struct LR
 			{
@@ -159,13 +346,10 @@ public:
 			return lines;
 		}
 
-		int getNextColumn(Point<int> pos)
-		{
-
-		}
-
 		Point<int> getPositionInLine(int col, OutOfBoundsMode mode) const
 		{
+			ensureGlyphsArePlaced();
+
 			if (isPositiveAndBelow(col, positions.size()))
 				return positions[col];
 
@@ -245,54 +429,206 @@ public:
 			return { l, col };
 		}
 
-		int getLength() const
+		int64 getNumBytes() const
 		{
-			return string.length() + 1;
+			return (int64)sizeof(Layout) +
+				   MemoryUsage::getStringBytes(string) +
+				   (shaped != nullptr ? shaped->getNumBytes() : 0) +
+				   MemoryUsage::getArrayBytes(rowStarts) +
+				   MemoryUsage::getGlyphArrangementBytes(glyphs) +
+				   MemoryUsage::getGlyphArrangementBytes(glyphsWithTrailingSpace) +
+				   MemoryUsage::getArrayBytes(positions) +
+				   MemoryUsage::getArrayBytes(charactersPerLine);
 		}
 
 		Rectangle<float> characterBounds;
 		Array<int> charactersPerLine;
 
 		float height = 0.0f;
+		float rowHeight = 0.0f;
+
+		/** The line width that the glyphs are wrapped to (-1 if they are not wrapped). */
+		int maxColumns = -1;
 
-		int maxColumns = 0;
+	private:
+
+		mutable juce::GlyphArrangement glyphsWithTrailingSpace;
+		mutable juce::GlyphArrangement glyphs;
+		mutable Array<Point<int>> positions;
+		mutable bool glyphsArePlaced = false;
 	};
 
-	struct Cache
+	/** A line of the document. The tokens belong to the line, the layout is shared. */
+	struct Entry : public ReferenceCountedObject,
+				   public MemoryUsage::Tracked<MemoryUsage::Glyphs>
 	{
-		struct Item
+		using Ptr = ReferenceCountedObjectPtr<Entry>;
+
+		Entry() {}
+		Entry(const juce::String& string);
+		Entry(const juce::String& string, const LineScanner::Line& info);
+
+		/** Returns the character at the column in constant time (the UTF-8 string needs to be walked from the start). */
+		juce_wchar getCharacter(int column) const
 		{
-			int64 hash;
-			Entry::Ptr p;
-		};
+			jassert(isPositiveAndBelow(column, length));
+			return isASCII ? (juce_wchar)(uint8)string.toRawUTF8()[column] : characters[column];
+		}
+
+		/** Creates a string from the character range in O(range length). */
+		juce::String getSubstring(Range<int> range) const;
+
+		juce::String string;
+		juce::Array<int> tokens;
+
+		/** ASCII lines are indexed in the UTF-8 bytes, the other lines are expanded to UTF-32. */
+		HeapBlock<juce_wchar> characters;
+		int length = 0;
+		bool isASCII = true;
+		bool hasTabs = false;
+
+		Layout::Ptr layout;
+
+		/** The layouts of the chunks if the line is chunked (null until they are painted). */
+		Array<Layout::Ptr> chunks;
 
-		Cache()
+		/** Returns the layout of the line (or an empty one if it hasn't been created yet). */
+		const Layout& getLayout() const
 		{
+			if (layout != nullptr)
+				return *layout;
 
+			static const Layout empty;
+			return empty;
 		}
 
-		Entry::Ptr getCachedItem(int line, int64 hash) const
+		int getLength() const
 		{
-			if (isPositiveAndBelow(line, cachedItems.size()))
-			{
-				auto l = cachedItems.begin() + line;
+			return length + 1;
+		}
 
-				if (l->hash == hash)
-					return l->p;
-			}
+		/** Adds everything except for the layout, which might be shared with other lines. */
+		void addMemoryUsage(MemoryUsage& m) const
+		{
+			m.add(MemoryUsage::Document, MemoryUsage::getStringBytes(string));
+			m.add(MemoryUsage::Document, isASCII ? 0 : (int64)length * (int64)sizeof(juce_wchar));
+			m.add(MemoryUsage::Tokens, MemoryUsage::getArrayBytes(tokens));
+			m.add(MemoryUsage::Glyphs, (int64)sizeof(Entry) + MemoryUsage::getArrayBytes(chunks));
+		}
+	};
+
+	/** The values of every line that are needed when all rows are scanned (for the row
+		positions, the document bounds or the layout hashes).
 
-			return nullptr;
+		They are stored in parallel arrays next to the entries, so these loops don't have
+		to touch the entries or their layouts.
+	*/
+	struct LineMetadata
+	{
+		enum Flags
+		{
+			GlyphsDirty = 1,	///< the layout needs to be created
+			TokensDirty = 2,	///< the tokens are not up to date
+			WidthChanged = 4	///< the line width has changed since the layout was created
+		};
+
+		void insert(int index, int numCharacters, float fontHeight);
+		void removeRange(int startIndex, int numToRemove);
+		void clear();
+
+		void setFlags(int index, uint8 flagsToSet) { flags.getReference(index) |= flagsToSet; }
+		void clearFlags(int index, uint8 flagsToClear) { flags.getReference(index) &= (uint8)~flagsToClear; }
+		bool hasFlag(int index, uint8 flag) const { return (flags.getUnchecked(index) & flag) != 0; }
+
+		int64 getNumBytes() const;
+
+		Array<float> heights;
+		Array<int> numColumns;
+		Array<uint32> ids;
+		Array<uint8> flags;
+
+	private:
+
+		/** A unique number for every line, so you can detect if a line was replaced. */
+		static uint32 createId()
+		{
+			static std::atomic<uint32> counter = { 0 };
+			return ++counter;
 		}
+	};
+
+	/** Returns the layout of the line and creates it if necessary. Chunked lines don't have
+		a layout for the whole line, so this returns an empty layout for them.
+	*/
+	const Layout& getLayout(int index) const;
+
+	/** The number of lines above and below the visible lines that keep their layouts. */
+	static constexpr int NumLinesToKeepLayouts = 1024;
+
+	/** Releases the layouts of the lines that were scrolled far away from the visible lines, so
+		the LayoutCache can remove them. They are recreated (usually from the cache) when the line
+		is accessed again.
+
+		Only the lines that were kept by the last call are released, so this doesn't touch every
+		line when the view is scrolled. Wrapped lines keep their layout because their height
+		depends on it, but the chunks of long lines are always released.
+	*/
+	void releaseLayoutsOutside(Range<int> visibleLines);
+
+	/** A process wide LRU cache of line layouts.
+
+		The layouts are looked up by their text, font and line width, so they can be
+		reused when the lines are moved around (eg. if a line was inserted above them)
+		and lines with the same text (empty lines, brackets etc.) share the same layout.
+		Layouts that are still used by a line are never removed, so the cache can grow
+		beyond MaxNumLayouts if the lines use more layouts than that.
+	*/
+	class LayoutCache
+	{
+	public:
+
+		static constexpr int MaxNumLayouts = 8192;
+
+		/** Creates the lookup key for the layout of the given text. */
+		static int64 createKey(const String& text, const Font& font, int maxLineWidth);
+
+		/** Returns the cached layout or nullptr if there is no layout for the key. */
+		Layout::Ptr get(int64 key, const String& text, int maxLineWidth);
+
+		/** Adds a new layout and removes the least recently used layouts if the cache is full. */
+		void add(int64 key, Layout::Ptr layout);
 
-		Array<Item> cachedItems;
-	} cache;
+		void clear();
+
+		int getNumLayouts() const { return items.size(); }
+
+	private:
+
+		void removeUnusedLayouts();
+
+		struct Item
+		{
+			Layout::Ptr layout;
+			uint32 lastUsed = 0;
+		};
+
+		HashMap<int64, Item> items;
+		uint32 counter = 0;
+
+		/** The number of layouts at which the next sweep happens. */
+		int sweepThreshold = MaxNumLayouts;
+	};
 
 	static int roundToTab(int c)
 	{
 		return c + 4 - c % 4;
 	}
 
+	/** Adds the estimated size of the lines to the memory usage. */
+	void addMemoryUsage(MemoryUsage& m) const;
+
 	mutable juce::ReferenceCountedArray<Entry> lines;
+	mutable LineMetadata metadata;
 
 
 
@@ -308,8 +644,28 @@ private:
 	friend class TextEditor;
 	juce::Font font;
 	bool cacheGlyphArrangement = true;
+	bool fixedPitch = false;
+
+	/** The lines that might have a layout from painting (see releaseLayoutsOutside()). */
+	Range<int> linesWithLayouts;
+
+	/** The length of the longest line or -1 if it needs to be calculated. */
+	mutable int maximumLength = 0;
+
+	SharedResourcePointer<LayoutCache> layoutCache;
+
+	void setMaxLineWidth(int newMaxLineWidth);
+
+	void insertEntry(int index, Entry* e);
 
+	bool canSkipLayout(int index) const;
+	Layout::Ptr createLayout(const String& text) const;
+	const Layout& getChunk(Entry* entry, int chunk) const;
 	void ensureValid(int index) const;
+	void updateMetadata(int index) const;
+	void updateGlyphs(Entry* entry) const;
+	void rewrapGlyphs(Entry* entry) const;
+	void wrapGlyphs(Layout& layout) const;
 	void invalidate(Range<int> lineRange);
 
 
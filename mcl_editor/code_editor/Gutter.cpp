@@ -18,29 +18,70 @@ using namespace juce;
 //==========================================================================
 mcl::GutterComponent::GutterComponent(TextDocument& document)
 	: document(document)
-	, memoizedGlyphArrangements([this](int row) { return getLineNumberGlyphs(row); })
 {
-	setRepaintsOnMouseActivity(true);
-
 }
 
 void mcl::GutterComponent::setViewTransform(const AffineTransform& transformToUse)
 {
 	transform = transformToUse;
-	repaint();
+	repaintLayer();
 }
 
 void mcl::GutterComponent::updateSelections()
 {
-	repaint();
+	repaintLayer();
 }
 
 void mcl::GutterComponent::paint(Graphics& g)
 {
-#if PROFILE_PAINTS
-	auto start = Time::getMillisecondCounterHiRes();
-#endif
+	Profiler::ScopedTimer st(Profiler::Gutter);
+
+	auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+	auto layerBounds = getLayerBounds();
+
+	auto w = roundToInt((float)layerBounds.getWidth() * scale);
+	auto h = roundToInt((float)layerBounds.getHeight() * scale);
+
+	if (cachedLayer.isNull() || cachedLayer.getWidth() != w || cachedLayer.getHeight() != h || cachedLayerScale != scale)
+	{
+		cachedLayer = w > 0 && h > 0 ? Image(Image::ARGB, w, h, true) : Image();
+		cachedLayerScale = scale;
+		layerIsDirty = true;
+	}
+
+	if (cachedLayer.isNull())
+		return;
+
+	if (layerIsDirty)
+	{
+		cachedLayer.clear(cachedLayer.getBounds());
+
+		Graphics lg(cachedLayer);
+		lg.addTransform(AffineTransform::scale(scale));
+		renderLayer(lg, layerBounds);
+
+		layerIsDirty = false;
+	}
 
+	g.drawImageTransformed(cachedLayer, AffineTransform::scale(1.0f / scale));
+
+	paintHoverOverlay(g);
+}
+
+juce::Rectangle<int> mcl::GutterComponent::getLayerBounds() const
+{
+	// the gutter area and the shadow next to it
+	return getLocalBounds().withWidth(jmin(getWidth(), (int)std::ceil(getGutterWidth()) + 12));
+}
+
+void mcl::GutterComponent::repaintLayer()
+{
+	layerIsDirty = true;
+	repaint();
+}
+
+void mcl::GutterComponent::renderLayer(Graphics& g, Rectangle<int> layerBounds)
+{
 	/*
 	 Draw the gutter background, shadow, and outline
 	 ------------------------------------------------------------------
@@ -51,11 +92,11 @@ void mcl::GutterComponent::paint(Graphics& g)
 	auto GUTTER_WIDTH = getGutterWidth();
 
 	g.setColour(ln);
-	g.fillRect(getLocalBounds().removeFromLeft(GUTTER_WIDTH));
+	g.fillRect(layerBounds.removeFromLeft(GUTTER_WIDTH));
 
 	if (transform.getTranslationX() < GUTTER_WIDTH)
 	{
-		auto shadowRect = getLocalBounds().withLeft(GUTTER_WIDTH).withWidth(12);
+		auto shadowRect = layerBounds.withWidth(12);
 
 		auto gradient = ColourGradient::horizontal(ln.contrasting().withAlpha(0.3f),
 			Colours::transparentBlack, shadowRect);
@@ -72,9 +113,10 @@ void mcl::GutterComponent::paint(Graphics& g)
 	 Draw the line numbers and selected rows
 	 ------------------------------------------------------------------
 	 */
-	auto area = g.getClipBounds().toFloat().transformedBy(transform.inverted());
-	auto rowData = document.findRowsIntersecting(area);
-	auto verticalTransform = transform.withAbsoluteTranslation(0.f, transform.getTranslationY());
+	// only the vertical position of the rows is needed here
+	auto area = getLocalBounds().toFloat().transformedBy(transform.inverted());
+	visibleRows = document.findRowsIntersecting(area, false);
+	const auto& rowData = visibleRows;
 
 	auto f = document.getFont();
 
@@ -96,46 +138,9 @@ void mcl::GutterComponent::paint(Graphics& g)
 
 		auto b = getRowBounds(r);
 
-		
-			
-
-		bool showFoldRange = false;
-
 		auto t = h.getLineType(r.rowNumber);
 
-		if (isMouseOver(true))
-		{
-			auto pos = getMouseXYRelative().toFloat();
-
-			if (b.contains(pos))
-			{
-				hoveredData = r;
-
-				auto range = h.getRangeForLineNumber(r.rowNumber);
-
-				for (const auto& inner : rowData)
-				{
-					if (!h.isFolded(inner.rowNumber) && range.contains(inner.rowNumber))
-					{
-						auto ib = getRowBounds(inner);
-						g.setColour(Colours::white.withAlpha(0.1f));
-
-						ib = ib.removeFromRight(15.0f * transform.getScaleFactor());
-
-						if (t == FoldableLineRange::Holder::RangeStartClosed)
-						{
-							ib = ib.withWidth(getGutterWidth()).withX(0);
-							showFoldRange = true;
-						}
-
-						g.fillRect(ib);
-					}
-				}
-			}
-		}
-
-
-		if ((r.isRowSelected || isErrorLine) && !showFoldRange)
+		if (r.isRowSelected || isErrorLine)
 		{
 			g.setColour(ln.contrasting(0.1f));
 			g.fillRect(b);
@@ -222,27 +227,146 @@ void mcl::GutterComponent::paint(Graphics& g)
 		
 
 		g.setColour(getParentComponent()->findColour(CodeEditorComponent::lineNumberTextId));
-		g.drawText(String(r.rowNumber + 1), A.reduced(5.0f, gap), Justification::topRight, false);
-
-		//memoizedGlyphArrangements (r.rowNumber).draw(g, verticalTransform);
+		digitGlyphs.drawNumber(g, f, r.rowNumber + 1, A.reduced(5.0f, gap));
 	}
 
 	
 
 	
+}
+
+void mcl::GutterComponent::paintHoverOverlay(Graphics& g)
+{
+	if (hoveredRow == -1)
+		return;
+
+	auto& h = document.getFoldableLineRangeHolder();
+	auto range = h.getRangeForLineNumber(hoveredRow);
+
+	if (range.isEmpty())
+		return;
+
+	auto showFoldRange = h.getLineType(hoveredRow) == FoldableLineRange::Holder::RangeStartClosed;
+
+	g.setColour(Colours::white.withAlpha(0.1f));
+
+	for (const auto& inner : visibleRows)
+	{
+		if (!h.isFolded(inner.rowNumber) && range.contains(inner.rowNumber))
+		{
+			auto ib = getRowBounds(inner);
+
+			ib = ib.removeFromRight(15.0f * transform.getScaleFactor());
 
-#if PROFILE_PAINTS
-	std::cout << "[GutterComponent::paint] " << Time::getMillisecondCounterHiRes() - start << std::endl;
-#endif
+			if (showFoldRange)
+				ib = ib.withWidth(getGutterWidth()).withX(0);
+
+			g.fillRect(ib);
+		}
+	}
+}
+
+int mcl::GutterComponent::getRowAtPosition(Point<float> position) const
+{
+	for (const auto& r : visibleRows)
+	{
+		if (getRowBounds(r).contains(position))
+			return r.rowNumber;
+	}
+
+	return -1;
 }
 
-GlyphArrangement mcl::GutterComponent::getLineNumberGlyphs(int row) const
+void mcl::GutterComponent::mouseMove(const MouseEvent& event)
 {
-	GlyphArrangement glyphs;
-	glyphs.addLineOfText(document.getFont().withHeight(12.f),
-		String(row + 1),
-		8.f, document.getVerticalPosition(row, TextDocument::Metric::baseline));
-	return glyphs;
+	auto newRow = getRowAtPosition(event.position);
+
+	if (newRow != hoveredRow)
+	{
+		hoveredRow = newRow;
+		repaint(getLayerBounds());
+	}
+}
+
+void mcl::GutterComponent::mouseExit(const MouseEvent& event)
+{
+	if (hoveredRow != -1)
+	{
+		hoveredRow = -1;
+		repaint(getLayerBounds());
+	}
+}
+
+void mcl::GutterComponent::addMemoryUsage(MemoryUsage& m) const
+{
+	m.add(MemoryUsage::Gutter, digitGlyphs.getNumBytes());
+	m.add(MemoryUsage::Gutter, (int64)cachedLayer.getWidth() * (int64)cachedLayer.getHeight() * 4);
+	m.add(MemoryUsage::Gutter, MemoryUsage::getArrayBytes(visibleRows));
+}
+
+//==========================================================================
+mcl::GutterComponent::DigitGlyphCache::DigitSet::DigitSet(const Font& f) :
+	font(f)
+{
+	GlyphArrangement ga;
+	ga.addLineOfText(font, "0123456789", 0.0f, 0.0f);
+
+	jassert(ga.getNumGlyphs() == 10);
+
+	for (int i = 0; i < jmin(10, ga.getNumGlyphs()); i++)
+	{
+		digits[i] = ga.getGlyph(i);
+		widths[i] = digits[i].getRight() - digits[i].getLeft();
+	}
+}
+
+mcl::GutterComponent::DigitGlyphCache::DigitSet& mcl::GutterComponent::DigitGlyphCache::getDigitSet(const Font& f)
+{
+	for (int i = 0; i < sets.size(); i++)
+	{
+		if (sets[i]->font == f)
+		{
+			if (i != 0)
+				sets.move(i, 0);
+
+			return *sets.getFirst();
+		}
+	}
+
+	sets.insert(0, new DigitSet(f));
+
+	if (sets.size() > MaxNumFonts)
+		sets.removeLast();
+
+	return *sets.getFirst();
+}
+
+void mcl::GutterComponent::DigitGlyphCache::drawNumber(Graphics& g, const Font& f, int number, Rectangle<float> area)
+{
+	jassert(number >= 0);
+
+	auto& d = getDigitSet(f);
+
+	auto x = area.getRight();
+	auto baseline = area.getY() + f.getAscent();
+
+	// go from the last digit to the left
+	do
+	{
+		auto digit = number % 10;
+		const auto& glyph = d.digits[digit];
+
+		x -= d.widths[digit];
+		glyph.draw(g, AffineTransform::translation(x - glyph.getLeft(), baseline - glyph.getBaselineY()));
+
+		number /= 10;
+	}
+	while (number > 0);
+}
+
+juce::int64 mcl::GutterComponent::DigitGlyphCache::getNumBytes() const
+{
+	return (int64)sets.size() * (int64)sizeof(DigitSet);
 }
 
 bool mcl::GutterComponent::hitTest(int x, int y)
@@ -266,7 +390,10 @@ juce::Rectangle<float> mcl::GutterComponent::getRowBounds(const TextDocument::Ro
 
 void mcl::GutterComponent::mouseDown(const MouseEvent& e)
 {
-	document.getFoldableLineRangeHolder().toggleFoldState(hoveredData.rowNumber);
+	auto row = getRowAtPosition(e.position);
+
+	if (row != -1)
+		document.getFoldableLineRangeHolder().toggleFoldState(row);
 }
 
 
@@ -19,6 +19,12 @@ using namespace juce;
 
 
 //==============================================================================
+/** Draws the line numbers, the selected rows and the fold markers.
+
+	Everything except the fold range hover effect is rendered into a cached
+	image, which is only redrawn after a scroll, an edit, a fold or a selection
+	change. Moving the mouse just draws the hover overlay on top of it.
+*/
 class mcl::GutterComponent : public juce::Component,
 							 public FoldableLineRange::Listener
 {
@@ -34,23 +40,25 @@ public:
 		return w * scaleFactor;
 	}
 
+	void addMemoryUsage(MemoryUsage& m) const;
+
 	void foldStateChanged(FoldableLineRange::WeakPtr rangeThatHasChanged) override
 	{
-		repaint();
+		repaintLayer();
 	}
 
 	void rootWasRebuilt(FoldableLineRange::WeakPtr newRoot) override
 	{
-		repaint();
+		repaintLayer();
 	}
 
-	Rectangle<float> getRowBounds(const TextDocument::RowData& r) const;
+	/** Marks the cached image as dirty and repaints the gutter. */
+	void repaintLayer();
 
-	void mouseMove(const MouseEvent& event) override
-	{
-		repaint();
-	}
+	Rectangle<float> getRowBounds(const TextDocument::RowData& r) const;
 
+	void mouseMove(const MouseEvent& event) override;
+	void mouseExit(const MouseEvent& event) override;
 	void mouseDown(const MouseEvent& e) override;
 
 	bool hitTest(int x, int y) override;
@@ -58,10 +66,15 @@ public:
 	//==========================================================================
 	void paint(juce::Graphics& g) override;
 
+	void resized() override
+	{
+		repaintLayer();
+	}
+
 	void setScaleFactor(float newFactor)
 	{
 		scaleFactor = newFactor;
-		repaint();
+		repaintLayer();
 	}
 
 	
@@ -70,23 +83,63 @@ public:
 	{
 		errorLine = lineNumber;
 		errorMessage = error;
-		repaint();
+		repaintLayer();
 	}
 
 private:
 
-	TextDocument::RowData hoveredData;
+	/** A small LRU cache of the digit glyphs for the last used fonts.
+
+		A line number is drawn from the ten digit glyphs of its font, so the size
+		of the cache doesn't depend on the number of rows and a zoom change just
+		creates (or reuses) the set for the new font height.
+	*/
+	struct DigitGlyphCache
+	{
+		static constexpr int MaxNumFonts = 4;
+
+		/** Draws the number right aligned at the top of the area (like Graphics::drawText with Justification::topRight). */
+		void drawNumber(Graphics& g, const Font& f, int number, Rectangle<float> area);
+
+		int64 getNumBytes() const;
+
+	private:
+
+		struct DigitSet
+		{
+			DigitSet(const Font& f);
+
+			Font font;
+			PositionedGlyph digits[10];
+			float widths[10];
+		};
+
+		DigitSet& getDigitSet(const Font& f);
+
+		OwnedArray<DigitSet> sets; // the most recently used font is the first element
+	};
+
+	Rectangle<int> getLayerBounds() const;
+	void renderLayer(Graphics& g, Rectangle<int> layerBounds);
+	void paintHoverOverlay(Graphics& g);
+	int getRowAtPosition(Point<float> position) const;
+
+	Image cachedLayer;
+	float cachedLayerScale = 0.0f;
+	bool layerIsDirty = true;
+
+	Array<TextDocument::RowData> visibleRows;
+	int hoveredRow = -1;
 
-	int errorLine;
+	int errorLine = -1;
 	String errorMessage;
 
 	float scaleFactor = 1.0f;
 
-	juce::GlyphArrangement getLineNumberGlyphs(int row) const;
 	//==========================================================================
 	TextDocument& document;
 	juce::AffineTransform transform;
-	Memoizer<int, juce::GlyphArrangement> memoizedGlyphArrangements;
+	DigitGlyphCache digitGlyphs;
 };
 
 
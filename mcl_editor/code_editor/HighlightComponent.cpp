@@ -25,69 +25,170 @@ void mcl::HighlightComponent::setViewTransform(const AffineTransform& transformT
 {
 	transform = transformToUse;
 
-	outlinePath.clear();
-	auto clip = getLocalBounds().toFloat().transformedBy(transform.inverted());
+	// the outlines are in document space, so this only builds the ones that became visible
+	updateOutlines();
+}
+
+void mcl::HighlightComponent::updateSelections()
+{
+	updateOutlines();
+}
+
+void mcl::HighlightComponent::updateOutlines()
+{
+	auto visibleRows = document.getRangeOfRowsIntersecting(getLocalBounds().toFloat().transformedBy(transform.inverted()));
+
+	// the hashes and paths only cover the visible part of the selections (with a margin)
+	auto firstCulledRow = jmax(0, (visibleRows.getStart() - CullMarginRows) / CullMarginRows * CullMarginRows);
+	auto lastCulledRow = (visibleRows.getEnd() + 2 * CullMarginRows - 1) / CullMarginRows * CullMarginRows;
+	Range<int> culledRows(firstCulledRow, lastCulledRow);
+
+	Array<Outline> newOutlines;
+	Array<bool> wasReused;
+	wasReused.insertMultiple(0, false, outlines.size());
+
+	Rectangle<float> dirtyArea;
+	int searchStart = 0;
+
+	for (auto s : document.getSelections())
+	{
+		s = s.oriented();
+
+		Range<int> rows(s.head.x, s.tail.x + 1);
 
-	for (const auto& s : document.getSelections())
+		if (!rows.intersects(visibleRows))
+			continue;
+
+		s = getCulledSelection(s, culledRows);
+		rows = Range<int>(s.head.x, s.tail.x + 1);
+
+		auto hash = document.getLayoutHash(rows);
+		bool found = false;
+
+		// The selections are usually in the same order as before, so start after the last match
+		for (int i = 0; i < outlines.size(); i++)
+		{
+			auto index = (searchStart + i) % outlines.size();
+			const auto& o = outlines.getReference(index);
+
+			if (!wasReused[index] && o.selection == s && o.layoutHash == hash)
+			{
+				newOutlines.add(o);
+				wasReused.set(index, true);
+				searchStart = index + 1;
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+		{
+			Outline o;
+			o.selection = s;
+			o.layoutHash = hash;
+			o.path = getOutlinePath(s);
+			o.bounds = o.path.getBounds();
+
+			dirtyArea = dirtyArea.getUnion(o.bounds);
+			newOutlines.add(o);
+		}
+	}
+
+	for (int i = 0; i < outlines.size(); i++)
 	{
-		outlinePath.addPath(getOutlinePath(s, clip));
+		if (!wasReused[i])
+			dirtyArea = dirtyArea.getUnion(outlines.getReference(i).bounds);
 	}
-	repaint(outlinePath.getBounds().getSmallestIntegerContainer());
+
+	outlines.swapWith(newOutlines);
+
+	if (!dirtyArea.isEmpty())
+		repaint(dirtyArea.transformedBy(transform).getSmallestIntegerContainer().expanded(2));
 }
 
-void mcl::HighlightComponent::updateSelections()
+void mcl::HighlightComponent::paintHighlight(Graphics& g)
+{
+	paintFrame(g, createFrame());
+}
+
+mcl::HighlightComponent::Frame mcl::HighlightComponent::createFrame() const
 {
-	outlinePath.clear();
-	auto clip = getLocalBounds().toFloat().transformedBy(transform.inverted());
+	Frame f;
+	f.colour = getParentComponent()->findColour(CodeEditorComponent::highlightColourId);
 
-	for (const auto& s : document.getSelections())
+	for (const auto& o : outlines)
 	{
-		outlinePath.addPath(getOutlinePath(s.oriented(), clip));
+		f.paths.add(o.path);
+		f.bounds.add(o.bounds);
 	}
-	repaint(outlinePath.getBounds().getSmallestIntegerContainer());
+
+	for (auto sr : document.getSearchResults())
+	{
+		for (auto r : document.getSelectionRegion(sr))
+			f.searchResults.add(r);
+	}
+
+	return f;
 }
 
-void mcl::HighlightComponent::paintHighlight(Graphics& g)
+void mcl::HighlightComponent::paintFrame(Graphics& g, const Frame& f)
 {
-	//g.addTransform(transform);
-	auto highlight = getParentComponent()->findColour(CodeEditorComponent::highlightColourId);
-	g.setColour(highlight);
+	Profiler::ScopedTimer st(Profiler::Highlight);
 
-	DropShadow sh;
-	sh.colour = Colours::black.withAlpha(0.4f);
-	sh.radius = 8;
-	sh.offset = { 0, 3 };
-	//sh.drawForPath(g, outlinePath);
+	auto c = f.colour.withAlpha(1.0f);
 
-	auto c = highlight.withAlpha(1.0f);
+	Rectangle<float> b;
 
-	auto b = outlinePath.getBounds();
+	for (const auto& ob : f.bounds)
+		b = b.getUnion(ob);
+
+	// the graphics context has the view transform, so the clip is in document space
+	auto clip = g.getClipBounds().toFloat();
 
 	g.setGradientFill(ColourGradient(c, 0.0f, b.getY(), c.darker(0.05f), 0.0f, b.getBottom(), false));
-	g.fillPath(outlinePath);
+
+	for (int i = 0; i < f.paths.size(); i++)
+	{
+		if (f.bounds.getReference(i).intersects(clip))
+			g.fillPath(f.paths.getReference(i));
+	}
 
 	g.setColour(Colour(0xff959595));
-	g.strokePath(outlinePath, PathStrokeType(1.f));
 
-	for (auto sr : document.getSearchResults())
+	for (int i = 0; i < f.paths.size(); i++)
 	{
-		auto r = document.getSelectionRegion(sr);
+		if (f.bounds.getReference(i).expanded(1.0f).intersects(clip))
+			g.strokePath(f.paths.getReference(i), PathStrokeType(1.f));
+	}
 
-		for (auto h : r)
-		{
-			h.removeFromBottom(h.getHeight() * 0.15f);
+	for (auto h : f.searchResults)
+	{
+		h.removeFromBottom(h.getHeight() * 0.15f);
 
-			h = h.translated(0.0f, h.getHeight() * 0.05f).expanded(2.0f);
+		h = h.translated(0.0f, h.getHeight() * 0.05f).expanded(2.0f);
 
-			g.setColour(Colours::white.withAlpha(0.2f));
-			g.fillRoundedRectangle(h, 2.0f);
-			g.setColour(Colours::red.withAlpha(0.4f));
-			g.drawRoundedRectangle(h, 2.0f, 1.0f);
-		}
+		g.setColour(Colours::white.withAlpha(0.2f));
+		g.fillRoundedRectangle(h, 2.0f);
+		g.setColour(Colours::red.withAlpha(0.4f));
+		g.drawRoundedRectangle(h, 2.0f, 1.0f);
 	}
 }
 
-Path mcl::HighlightComponent::getOutlinePath(const Selection& s, Rectangle<float> clip) const
+mcl::Selection mcl::HighlightComponent::getCulledSelection(Selection s, Range<int> rows) const
+{
+	if (s.head.x < rows.getStart())
+		s.head = { rows.getStart(), 0 };
+
+	if (s.tail.x >= rows.getEnd())
+	{
+		auto lastRow = rows.getEnd() - 1;
+		s.tail = { lastRow, document.getNumColumns(lastRow) };
+	}
+
+	return s;
+}
+
+Path mcl::HighlightComponent::getOutlinePath(const Selection& s) const
 {
 	RectangleList<float> list;
 	auto top = document.getUnderlines(s, TextDocument::Metric::top);
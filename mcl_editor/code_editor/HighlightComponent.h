@@ -280,6 +280,13 @@ public:
 
 
 //==============================================================================
+/** Draws the selection outlines and the search results.
+
+	The outline of every selection is cached in document space together with
+	the layout hash of its rows, so scrolling and zooming only build the paths
+	of selections that became visible. An outline is rebuilt when its selection
+	or one of its rows changes.
+*/
 class mcl::HighlightComponent : public juce::Component,
 								public FoldableLineRange::Listener
 {
@@ -292,21 +299,53 @@ public:
 	//==========================================================================
 	void paintHighlight(juce::Graphics& g);
 
+	/** A copy of everything that paintHighlight() draws, so the highlights can be
+		painted on another thread without accessing the document.
+	*/
+	struct Frame
+	{
+		juce::Colour colour;
+		juce::Array<juce::Path> paths;
+		juce::Array<juce::Rectangle<float>> bounds;
+		juce::Array<juce::Rectangle<float>> searchResults;
+	};
+
+	Frame createFrame() const;
+	static void paintFrame(juce::Graphics& g, const Frame& f);
+
 	void foldStateChanged(FoldableLineRange::WeakPtr p)
 	{
 		updateSelections();
 	}
 
 private:
-	juce::Path getOutlinePath(const Selection& rectangles, Rectangle<float> clip) const;
 
-	RectangleList<float> outlineRects;
+	/** The selections are culled to the visible rows plus this margin, rounded to multiples of
+		the margin, so the outlines of a huge selection can be reused while scrolling.
+	*/
+	static constexpr int CullMarginRows = 64;
+
+	struct Outline
+	{
+		Selection selection; // oriented and culled
+		int64 layoutHash = 0;
+		juce::Path path;
+		juce::Rectangle<float> bounds;
+	};
+
+	/** Reuses the cached outlines of the visible selections and builds the missing ones. */
+	void updateOutlines();
+
+	/** Returns the part of the oriented selection within the rows (starting and ending at the line boundaries if it's cut off). */
+	Selection getCulledSelection(Selection s, juce::Range<int> rows) const;
+
+	juce::Path getOutlinePath(const Selection& rectangles) const;
 
 	//==========================================================================
 	bool useRoundedHighlight = true;
 	TextDocument& document;
 	juce::AffineTransform transform;
-	juce::Path outlinePath;
+	juce::Array<Outline> outlines;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+void mcl::LineOffsetTable::rebuild(const CodeDocument& doc)
+{
+	auto numLines = doc.getNumLines();
+
+	lines.clearQuick();
+	lines.ensureStorageAllocated(numLines);
+
+	for (int i = 0; i < numLines; i++)
+		lines.add(createLine(doc, i));
+
+	numCharacters = doc.getNumCharacters();
+}
+
+void mcl::LineOffsetTable::update(const CodeDocument& doc, int firstLine, int numToRemove, int numToInsert, int numCharactersDelta)
+{
+	lines.removeRange(firstLine, numToRemove);
+	lines.insertMultiple(firstLine, {}, numToInsert);
+
+	for (int i = firstLine; i < firstLine + numToInsert; i++)
+		lines.setUnchecked(i, createLine(doc, i));
+
+	// This is the only part that depends on the document size, but it's
+	// a tight loop over integers without any lookups into the document
+	auto data = lines.getRawDataPointer();
+
+	for (int i = firstLine + numToInsert; i < lines.size(); i++)
+		data[i].start += numCharactersDelta;
+
+	numCharacters += numCharactersDelta;
+
+	jassert(numCharacters == doc.getNumCharacters());
+	jassert(lines.size() == doc.getNumLines());
+}
+
+int mcl::LineOffsetTable::getRow(int offset) const
+{
+	if (lines.isEmpty() || offset <= 0)
+		return 0;
+
+	// find the last line that starts at or before the offset
+	auto first = lines.begin();
+	auto it = std::upper_bound(first, lines.end(), offset, [](int o, const Line& l) { return o < l.start; });
+
+	return jmax(0, (int)(it - first) - 1);
+}
+
+juce::Point<int> mcl::LineOffsetTable::getIndex(int offset) const
+{
+	if (lines.isEmpty())
+		return {};
+
+	auto row = getRow(offset);
+	const auto& l = lines.getReference(row);
+
+	return { row, jlimit(0, l.length, offset - l.start) };
+}
+
+
+}
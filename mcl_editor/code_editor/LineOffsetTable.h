@@ -0,0 +1,101 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+/**
+	A table of the line start offsets of a CodeDocument.
+
+	It converts (row, column) indexes to character offsets in constant time and
+	character offsets to (row, column) with a binary search, so you don't have to
+	create CodeDocument::Position objects for this. The clamping of out of range
+	values matches the CodeDocument::Position constructors.
+
+	The table must be updated with every change of the document (the TextDocument
+	does this in its codeChanged() callback).
+*/
+class LineOffsetTable
+{
+public:
+
+	/** Rebuilds the whole table from the document. */
+	void rebuild(const CodeDocument& doc);
+
+	/** Updates the table after an edit. The lines in [firstLine, firstLine + numToRemove)
+		are replaced by numToInsert lines from the (already changed) document and the
+		lines after them are moved by numCharactersDelta.
+	*/
+	void update(const CodeDocument& doc, int firstLine, int numToRemove, int numToInsert, int numCharactersDelta);
+
+	/** Returns the character offset of the given (row, column) index. */
+	int getOffset(Point<int> index) const
+	{
+		if (lines.isEmpty() || index.x < 0)
+			return 0;
+
+		if (index.x >= lines.size())
+			return getEndOfLine(lines.size() - 1);
+
+		const auto& l = lines.getReference(index.x);
+		return l.start + jlimit(0, l.length, index.y);
+	}
+
+	/** Returns the row that contains the given character offset. */
+	int getRow(int offset) const;
+
+	/** Returns the (row, column) index of the given character offset. */
+	Point<int> getIndex(int offset) const;
+
+	int getLineStart(int row) const { return isPositiveAndBelow(row, lines.size()) ? lines.getReference(row).start : 0; }
+
+	/** Returns the length of the line without the line break characters. */
+	int getLineLength(int row) const { return isPositiveAndBelow(row, lines.size()) ? lines.getReference(row).length : 0; }
+
+	int getNumLines() const { return lines.size(); }
+
+	int getNumCharacters() const { return numCharacters; }
+
+	int64 getNumBytes() const { return MemoryUsage::getArrayBytes(lines); }
+
+private:
+
+	struct Line
+	{
+		int start;
+		int length;		// without the line break
+	};
+
+	static Line createLine(const CodeDocument& doc, int row)
+	{
+		// The CodeDocument clamps the index to the line length, so this is a constant time lookup
+		CodeDocument::Position end(doc, row, std::numeric_limits<int>::max());
+		return { end.getPosition() - end.getIndexInLine(), end.getIndexInLine() };
+	}
+
+	int getEndOfLine(int row) const
+	{
+		const auto& l = lines.getReference(row);
+		return l.start + l.length;
+	}
+
+	Array<Line> lines;
+	int numCharacters = 0;
+};
+
+
+}
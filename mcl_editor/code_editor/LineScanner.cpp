@@ -0,0 +1,414 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+void mcl::LineScanner::scan(const char* utf8, int numBytes)
+{
+	clear();
+
+	if (numBytes <= 0)
+		return;
+
+	State s;
+	int position = 0;
+
+#if MCL_SIMD_AVAILABLE
+	using B = Block;
+
+	auto lineFeed = B::broadcast('\n');
+	auto carriageReturn = B::broadcast('\r');
+	auto tab = B::broadcast('\t');
+	auto topBits = B::broadcast(0xC0);
+	auto continuationByte = B::broadcast(0x80);
+
+	for (; position + B::Size <= numBytes; position += B::Size)
+	{
+		auto v = B::load(utf8 + position);
+
+		auto breaks = B::toBitMask(B::bitOr(B::equal(v, lineFeed), B::equal(v, carriageReturn)));
+		auto tabs = B::toBitMask(B::equal(v, tab));
+		auto nonASCII = B::toBitMask(v);
+		auto continuationBytes = B::toBitMask(B::equal(B::bitAnd(v, topBits), continuationByte));
+
+		while (breaks != 0)
+		{
+			auto index = countNumberOfBits((breaks & (0u - breaks)) - 1);
+
+			// the bytes before the line break belong to the current line,
+			// the line break and the bytes before it are removed from the masks
+			auto before = (1u << index) - 1u;
+			auto processed = ((1u << index) << 1) - 1u;
+
+			s.addBits(tabs & before, nonASCII & before, continuationBytes & before);
+			endLine(utf8, position + index, s);
+
+			breaks &= ~processed;
+			tabs &= ~processed;
+			nonASCII &= ~processed;
+			continuationBytes &= ~processed;
+		}
+
+		s.addBits(tabs, nonASCII, continuationBytes);
+	}
+#endif
+
+	for (; position < numBytes; position++)
+	{
+		auto c = (uint8)utf8[position];
+
+		if (c == '\n' || c == '\r')
+			endLine(utf8, position, s);
+		else
+			s.addByte(c);
+	}
+
+	auto last = s.toLine(numBytes);
+	lines.add(last);
+	maximumLineLength = jmax(maximumLineLength, last.numCharacters);
+}
+
+void mcl::LineScanner::scanPerCharacter(const char* utf8, int numBytes)
+{
+	clear();
+
+	if (numBytes <= 0)
+		return;
+
+	CharPointer_UTF8 p(utf8);
+	auto end = utf8 + numBytes;
+
+	Line current = { 0, 0, 0, 0 };
+
+	for (;;)
+	{
+		auto position = (int)(p.getAddress() - utf8);
+		auto c = p.getAddress() < end ? p.getAndAdvance() : 0;
+
+		if (c == 0 || c == '\n' || c == '\r')
+		{
+			current.numBytes = position - current.start;
+			lines.add(current);
+			maximumLineLength = jmax(maximumLineLength, current.numCharacters);
+
+			if (c == 0)
+				break;
+
+			if (c == '\r' && p.getAddress() < end && *p == '\n')
+				++p;
+
+			current = { (int)(p.getAddress() - utf8), 0, 0, 0 };
+			continue;
+		}
+
+		current.numCharacters++;
+
+		if (c == '\t')
+			current.flags |= HasTabs;
+		else if (c >= 0x80)
+			current.flags |= NonASCII;
+	}
+}
+
+mcl::LineScanner::Line mcl::LineScanner::scanLine(const char* utf8, int numBytes) noexcept
+{
+	State s;
+	int position = 0;
+
+#if MCL_SIMD_AVAILABLE
+	using B = Block;
+
+	auto tab = B::broadcast('\t');
+	auto topBits = B::broadcast(0xC0);
+	auto continuationByte = B::broadcast(0x80);
+
+	for (; position + B::Size <= numBytes; position += B::Size)
+	{
+		auto v = B::load(utf8 + position);
+
+		if (B::isAscii(v))
+		{
+			s.addBits(B::toBitMask(B::equal(v, tab)), 0, 0);
+			continue;
+		}
+
+		s.addBits(B::toBitMask(B::equal(v, tab)), B::toBitMask(v),
+				  B::toBitMask(B::equal(B::bitAnd(v, topBits), continuationByte)));
+	}
+#endif
+
+	for (; position < numBytes; position++)
+		s.addByte((uint8)utf8[position]);
+
+	return s.toLine(numBytes);
+}
+
+int mcl::LineScanner::skipLines(const char*& start, const char* end, int numLines) noexcept
+{
+	auto p = start;
+	int numSkipped = 0;
+
+#if MCL_SIMD_AVAILABLE
+	using B = Block;
+
+	auto lineFeed = B::broadcast('\n');
+	auto carriageReturn = B::broadcast('\r');
+
+	while (numSkipped < numLines && p + B::Size <= end)
+	{
+		auto v = B::load(p);
+		auto lineFeeds = B::toBitMask(B::equal(v, lineFeed));
+		auto carriageReturns = B::toBitMask(B::equal(v, carriageReturn));
+
+		// the CR of a CR LF pair isn't a line break, the LF is
+		auto nextIsLineFeed = (p + B::Size < end && p[B::Size] == '\n') ? 1u : 0u;
+		auto followedByLineFeed = (lineFeeds >> 1) | (nextIsLineFeed << (B::Size - 1));
+
+		auto mask = lineFeeds | (carriageReturns & ~followedByLineFeed);
+		auto numInBlock = countNumberOfBits(mask);
+
+		if (numSkipped + numInBlock < numLines)
+		{
+			numSkipped += numInBlock;
+			p += B::Size;
+			continue;
+		}
+
+		// the last line break is in this block, so find its position
+		for (;;)
+		{
+			auto index = countNumberOfBits((mask & (0u - mask)) - 1);
+
+			if (++numSkipped == numLines)
+			{
+				start = p + index + 1;
+				return numSkipped;
+			}
+
+			mask &= mask - 1;
+		}
+	}
+#endif
+
+	while (numSkipped < numLines && p < end)
+	{
+		auto c = *p++;
+
+		if (c == '\n' || (c == '\r' && (p == end || *p != '\n')))
+			numSkipped++;
+	}
+
+	start = p;
+	return numSkipped;
+}
+
+const char* mcl::LineScanner::getInstructionSet() noexcept
+{
+#if MCL_SIMD_AVX2
+	return "avx2";
+#elif MCL_SIMD_SSE2
+	return "sse2";
+#elif MCL_SIMD_NEON
+	return "neon";
+#else
+	return "scalar";
+#endif
+}
+
+void mcl::LineScanner::clear()
+{
+	lines.clearQuick();
+	maximumLineLength = 0;
+	lastCarriageReturn = -2;
+}
+
+void mcl::LineScanner::endLine(const char* utf8, int position, State& s)
+{
+	// the LF of a CR LF pair doesn't start another line
+	if (utf8[position] == '\n' && position == lastCarriageReturn + 1)
+	{
+		s = State();
+		s.start = position + 1;
+		return;
+	}
+
+	auto l = s.toLine(position);
+	lines.add(l);
+	maximumLineLength = jmax(maximumLineLength, l.numCharacters);
+
+	if (utf8[position] == '\r')
+		lastCarriageReturn = position;
+
+	s = State();
+	s.start = position + 1;
+}
+
+
+#if JUCE_UNIT_TESTS
+
+/** Compares the SIMD paths of the LineScanner with the per character loops. */
+class LineScannerTests : public UnitTest
+{
+public:
+
+	LineScannerTests() :
+		UnitTest("LineScanner", "mcl")
+	{}
+
+	void runTest() override
+	{
+		beginTest("scan matches scanPerCharacter (" + String(LineScanner::getInstructionSet()) + ")");
+
+		for (auto& t : createTexts())
+			expectSameLines(t);
+
+		beginTest("skipLines matches the scalar reference");
+
+		for (auto& t : createTexts())
+			expectSameSkips(t);
+	}
+
+private:
+
+	/** The edge cases and random texts of all lengths around the block sizes. */
+	Array<MemoryBlock> createTexts()
+	{
+		Array<MemoryBlock> texts;
+
+		auto add = [&texts](const char* utf8)
+		{
+			texts.add(MemoryBlock(utf8, std::strlen(utf8)));
+		};
+
+		add("");
+		add("\n");
+		add("\r");
+		add("\r\n");
+		add("\n\r");
+		add("a\r\rb\r\n\nc");
+		add("\t\xc3\xa4\xe2\x82\xac\r");
+
+		// a CR LF pair and a lone CR that are split at the 16 and 32 byte blocks
+		for (auto position : { 15, 16, 31, 32, 63 })
+		{
+			MemoryOutputStream pair, lone;
+
+			for (int i = 0; i < position; i++)
+			{
+				pair.writeByte('x');
+				lone.writeByte('x');
+			}
+
+			pair.write("\r\nx", 3);
+			lone.write("\rx", 2);
+
+			texts.add(pair.getMemoryBlock());
+			texts.add(lone.getMemoryBlock());
+		}
+
+		static const char* pieces[] = { "a", "b", " ", "\t", "\n", "\r", "\r\n", "\xc3\xa4", "\xe2\x82\xac" };
+		auto r = getRandom();
+
+		for (int numPieces = 0; numPieces < 300; numPieces++)
+		{
+			MemoryOutputStream mo;
+
+			for (int i = 0; i < numPieces; i++)
+			{
+				auto piece = pieces[r.nextInt(numElementsInArray(pieces))];
+				mo.write(piece, std::strlen(piece));
+			}
+
+			texts.add(mo.getMemoryBlock());
+		}
+
+		return texts;
+	}
+
+	void expectSameLines(const MemoryBlock& text)
+	{
+		auto utf8 = static_cast<const char*>(text.getData());
+		auto numBytes = (int)text.getSize();
+
+		LineScanner simd, scalar;
+		simd.scan(utf8, numBytes);
+		scalar.scanPerCharacter(utf8, numBytes);
+
+		expectEquals(simd.getNumLines(), scalar.getNumLines());
+		expectEquals(simd.getMaximumLineLength(), scalar.getMaximumLineLength());
+
+		for (int i = 0; i < jmin(simd.getNumLines(), scalar.getNumLines()); i++)
+		{
+			auto& a = simd.getLine(i);
+			auto& b = scalar.getLine(i);
+
+			expectEquals(a.start, b.start);
+			expectEquals(a.numBytes, b.numBytes);
+			expectEquals(a.numCharacters, b.numCharacters);
+			expectEquals((int)a.flags, (int)b.flags);
+		}
+	}
+
+	void expectSameSkips(const MemoryBlock& text)
+	{
+		auto utf8 = static_cast<const char*>(text.getData());
+		auto end = utf8 + text.getSize();
+
+		LineScanner scanner;
+		scanner.scan(utf8, (int)text.getSize());
+
+		// every line but the first starts after a line break
+		auto numLineBreaks = jmax(0, scanner.getNumLines() - 1);
+
+		for (int numLines = 0; numLines <= numLineBreaks + 1; numLines++)
+		{
+			auto a = utf8;
+			auto b = utf8;
+
+			expectEquals(LineScanner::skipLines(a, end, numLines), skipLinesReference(b, end, numLines));
+			expect(a == b, "skipLines stopped at a different position");
+		}
+
+		// the first line of the scan starts where skipLines stops
+		for (int i = 0; i < scanner.getNumLines(); i++)
+		{
+			auto p = utf8;
+			LineScanner::skipLines(p, end, i);
+			expectEquals((int)(p - utf8), scanner.getLine(i).start);
+		}
+	}
+
+	static int skipLinesReference(const char*& start, const char* end, int numLines)
+	{
+		int numSkipped = 0;
+
+		while (numSkipped < numLines && start < end)
+		{
+			auto c = *start++;
+
+			if (c == '\n' || (c == '\r' && (start == end || *start != '\n')))
+				numSkipped++;
+		}
+
+		return numSkipped;
+	}
+};
+
+static LineScannerTests lineScannerTests;
+
+#endif
+
+
+}
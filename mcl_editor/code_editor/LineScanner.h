@@ -0,0 +1,132 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+/**
+	Finds the lines of a UTF-8 text and their statistics in a single pass.
+
+	The text is compared in blocks of 32 (AVX2) or 16 (SSE2 / NEON) bytes, which yields
+	bitmasks of the line breaks, tabs, non-ASCII and UTF-8 continuation bytes. The bytes
+	are only looked at one by one in the scalar fallback and for the tail of the text.
+
+	For every line you get the byte range, the number of characters and if it contains
+	tabs or non-ASCII characters, so the document lines can be created from the scan
+	without decoding the text again.
+*/
+class LineScanner
+{
+public:
+
+	enum Flags
+	{
+		NonASCII = 1,
+		HasTabs = 2
+	};
+
+	struct Line
+	{
+		bool isASCII() const noexcept { return (flags & NonASCII) == 0; }
+		bool hasTabs() const noexcept { return (flags & HasTabs) != 0; }
+
+		int start;				///< the byte offset of the line
+		int numBytes;			///< without the line break
+		int numCharacters;		///< the number of code points (without the line break)
+		uint8 flags;
+	};
+
+	/** Finds the lines of the text. The lines are split like StringArray::fromLines()
+		(at LF, CR LF and CR), so an empty text has no lines and a text that ends
+		with a line break has an empty last line.
+	*/
+	void scan(const char* utf8, int numBytes);
+
+	/** Does the same thing with a loop over every character. This is the reference for the benchmarks. */
+	void scanPerCharacter(const char* utf8, int numBytes);
+
+	/** Returns the statistics of a single line (line breaks are counted as characters). */
+	static Line scanLine(const char* utf8, int numBytes) noexcept;
+
+	int getNumLines() const noexcept { return lines.size(); }
+	const Line& getLine(int index) const noexcept { return lines.getReference(index); }
+
+	/** Returns the number of characters in the longest line. */
+	int getMaximumLineLength() const noexcept { return maximumLineLength; }
+
+	/** Moves start past the next numLines line breaks (or to the end) and returns the number
+		of line breaks that were skipped. The lines are split like scan() (at LF, CR LF and CR).
+
+		A CR that is the last byte before the end counts as a line break, so the range must
+		not end between the CR and the LF of a CR LF pair.
+	*/
+	static int skipLines(const char*& start, const char* end, int numLines) noexcept;
+
+	/** Returns the name of the instruction set that is used ("avx2", "sse2", "neon" or "scalar"). */
+	static const char* getInstructionSet() noexcept;
+
+private:
+
+#if MCL_SIMD_AVX2
+	using Block = WideByteBlock;
+#elif MCL_SIMD_AVAILABLE
+	using Block = ByteBlock;
+#endif
+
+	/** The statistics of the line that is being scanned. */
+	struct State
+	{
+		void addBits(uint32 tabs, uint32 nonASCII, uint32 continuationBytes) noexcept
+		{
+			flags |= (uint8)((tabs != 0 ? HasTabs : 0) | (nonASCII != 0 ? NonASCII : 0));
+			numContinuationBytes += countNumberOfBits(continuationBytes);
+		}
+
+		void addByte(uint8 c) noexcept
+		{
+			if (c == '\t')
+				flags |= HasTabs;
+			else if (c >= 0x80)
+			{
+				flags |= NonASCII;
+				numContinuationBytes += (c & 0xC0) == 0x80 ? 1 : 0;
+			}
+		}
+
+		Line toLine(int end) const noexcept
+		{
+			auto numBytes = end - start;
+			return { start, numBytes, numBytes - numContinuationBytes, flags };
+		}
+
+		int start = 0;
+		int numContinuationBytes = 0;
+		uint8 flags = 0;
+	};
+
+	void clear();
+
+	/** Adds the line that ends with the line break at the position. */
+	void endLine(const char* utf8, int position, State& s);
+
+	Array<Line> lines;
+	int maximumLineLength = 0;
+	int lastCarriageReturn = -2;
+};
+
+
+}
@@ -0,0 +1,96 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+juce::String mcl::MemoryUsage::getSubsystemName(Subsystem s)
+{
+	switch (s)
+	{
+	case Document:		return "Document";
+	case Glyphs:		return "Glyphs";
+	case Tokens:		return "Tokens";
+	case Folding:		return "Folding";
+	case CodeMap:		return "Code map";
+	case Gutter:		return "Gutter";
+	case UndoHistory:	return "Undo history";
+	case Autocomplete:	return "Autocomplete";
+	default:			break;
+	}
+
+	jassertfalse;
+	return {};
+}
+
+mcl::MemoryUsage::Counter& mcl::MemoryUsage::getCounter(Subsystem s)
+{
+	static Counter counters[numSubsystems];
+	return counters[s];
+}
+
+juce::int64 mcl::MemoryUsage::getTotal() const
+{
+	int64 total = 0;
+
+	for (auto b : bytes)
+		total += b;
+
+	return total;
+}
+
+mcl::MemoryUsage& mcl::MemoryUsage::operator+=(const MemoryUsage& other)
+{
+	for (int i = 0; i < numSubsystems; i++)
+		bytes[i] += other.bytes[i];
+
+	return *this;
+}
+
+juce::Array<mcl::MemoryUsage::Subsystem> mcl::MemoryUsage::getSubsystemsOverBudget(const MemoryUsage& budget) const
+{
+	Array<Subsystem> list;
+
+	for (int i = 0; i < numSubsystems; i++)
+	{
+		if (budget.bytes[i] > 0 && bytes[i] > budget.bytes[i])
+			list.add((Subsystem)i);
+	}
+
+	return list;
+}
+
+juce::String mcl::MemoryUsage::toString() const
+{
+	String s;
+
+	for (int i = 0; i < numSubsystems; i++)
+	{
+		s << getSubsystemName((Subsystem)i).paddedRight(' ', 14) << File::descriptionOfSizeInBytes(bytes[i]);
+
+#if MCL_TRACK_ALLOCATIONS
+		auto& c = getCounter((Subsystem)i);
+		s << " (" << String(c.numObjects.load()) << " tracked objects: " << File::descriptionOfSizeInBytes(c.numBytes.load()) << ")";
+#endif
+
+		s << "\n";
+	}
+
+	s << String("Total").paddedRight(' ', 14) << File::descriptionOfSizeInBytes(getTotal());
+
+	return s;
+}
+
+
+}
@@ -0,0 +1,123 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+/**
+	The memory footprint of an editor, split up into its subsystems.
+
+	Call TextEditor::getMemoryUsage() to get the numbers for a single editor. The
+	values are estimates that are calculated from the container sizes (the JUCE
+	containers don't expose their allocated capacity), so they don't include
+	the allocator overhead.
+
+	If you need to find leaks, enable MCL_TRACK_ALLOCATIONS: this counts every
+	instance of the heap allocated objects (glyph entries, undo steps, tokens)
+	with the exact number of bytes in a process wide counter (see getCounter()).
+*/
+struct MemoryUsage
+{
+	enum Subsystem
+	{
+		Document = 0,	///< the text of the CodeDocument and the line strings
+		Glyphs,			///< the GlyphArrangementArray layout data
+		Tokens,			///< the per character token arrays for syntax highlighting
+		Folding,		///< the foldable line ranges
+		CodeMap,		///< the minimap rectangles
+		Gutter,			///< the line number glyph cache
+		UndoHistory,	///< the undo steps of the UndoHistory
+		Autocomplete,	///< the token list of the TokenCollection
+		numSubsystems
+	};
+
+	/** A process wide counter of the tracked objects. */
+	struct Counter
+	{
+		std::atomic<int64> numObjects = { 0 };
+		std::atomic<int64> numBytes = { 0 };
+	};
+
+	/** Use this as base class for heap allocated objects that you want to count when MCL_TRACK_ALLOCATIONS is enabled.
+
+		It overloads the class specific operator new / delete so it doesn't add any data to the object.
+		The objects are allocated from the SlabPool, so creating and deleting them doesn't hit the heap
+		once the pool has grown to the peak number of objects.
+	*/
+	template <Subsystem S> struct Tracked
+	{
+		static void* operator new(size_t numBytes)
+		{
+#if MCL_TRACK_ALLOCATIONS
+			auto& c = getCounter(S);
+			c.numObjects++;
+			c.numBytes += (int64)numBytes;
+#endif
+			return SlabPool::allocate(numBytes);
+		}
+
+		static void operator delete(void* p, size_t numBytes)
+		{
+#if MCL_TRACK_ALLOCATIONS
+			auto& c = getCounter(S);
+			c.numObjects--;
+			c.numBytes -= (int64)numBytes;
+#endif
+			SlabPool::deallocate(p, numBytes);
+		}
+	};
+
+	static String getSubsystemName(Subsystem s);
+
+	/** Returns the counter for the given subsystem. This will only count something if MCL_TRACK_ALLOCATIONS is enabled. */
+	static Counter& getCounter(Subsystem s);
+
+	/** Returns the estimated heap size of a String (the text and the header of the shared buffer). */
+	static int64 getStringBytes(const String& s)
+	{
+		return s.isEmpty() ? 0 : (int64)(s.getNumBytesAsUTF8() + 1 + 2 * sizeof(size_t));
+	}
+
+	template <typename T> static int64 getArrayBytes(const Array<T>& a)
+	{
+		return (int64)a.size() * (int64)sizeof(T);
+	}
+
+	static int64 getGlyphArrangementBytes(const GlyphArrangement& g)
+	{
+		return (int64)g.getNumGlyphs() * (int64)sizeof(PositionedGlyph);
+	}
+
+	void add(Subsystem s, int64 numBytes) { bytes[s] += numBytes; }
+
+	int64 get(Subsystem s) const { return bytes[s]; }
+
+	int64 getTotal() const;
+
+	MemoryUsage& operator+=(const MemoryUsage& other);
+
+	/** Returns the subsystems that use more memory than the given budget. Budgets with zero bytes are ignored. */
+	Array<Subsystem> getSubsystemsOverBudget(const MemoryUsage& budget) const;
+
+	/** Creates a multiline report with one line per subsystem. */
+	String toString() const;
+
+	int64 bytes[numSubsystems] = {};
+};
+
+
+}
@@ -0,0 +1,301 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+mcl::Profiler::Profiler()
+{
+	static_assert((BufferSize & (BufferSize - 1)) == 0, "BufferSize must be a power of two");
+
+	enabled.store(PROFILE_PAINTS != 0);
+}
+
+mcl::Profiler& mcl::Profiler::getInstance()
+{
+	static Profiler instance;
+	return instance;
+}
+
+juce::String mcl::Profiler::getScopeName(Scope s)
+{
+	switch (s)
+	{
+	case Frame:		return "Frame";
+	case Layout:	return "Layout";
+	case Tokenise:	return "Tokenise";
+	case GlyphDraw:	return "Glyph draw";
+	case Gutter:	return "Gutter";
+	case Highlight:	return "Highlight";
+	case Caret:		return "Caret";
+	case Minimap:	return "Minimap";
+	default:		break;
+	}
+
+	jassertfalse;
+	return {};
+}
+
+double mcl::Profiler::getBucketLimit(int bucketIndex)
+{
+	static const double limits[NumBuckets] = { 0.1, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, std::numeric_limits<double>::max() };
+	return limits[jlimit(0, NumBuckets - 1, bucketIndex)];
+}
+
+void mcl::Profiler::setEnabled(bool shouldBeEnabled)
+{
+	if (shouldBeEnabled && !isEnabled())
+		clear();
+
+	enabled.store(shouldBeEnabled);
+}
+
+void mcl::Profiler::startFrame() noexcept
+{
+	currentFrame.fetch_add(1, std::memory_order_relaxed);
+}
+
+void mcl::Profiler::clear()
+{
+	clearIndex.store(writeIndex.load());
+}
+
+void mcl::Profiler::addEvent(Scope s, int64 start, int64 end) noexcept
+{
+	auto index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+	auto& e = events[index & (BufferSize - 1)];
+
+	e.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	e.frame = currentFrame.load(std::memory_order_relaxed);
+	e.scope = s;
+	e.start = start;
+	e.end = end;
+	e.threadId = (pointer_sized_int)Thread::getCurrentThreadId();
+
+	e.sequence.store(index + 1, std::memory_order_release);
+}
+
+juce::Array<mcl::Profiler::EventData> mcl::Profiler::getEvents() const
+{
+	Array<EventData> list;
+
+	auto end = writeIndex.load(std::memory_order_acquire);
+	auto numToRead = jmin<uint32>(end - clearIndex.load(), (uint32)BufferSize);
+
+	list.ensureStorageAllocated((int)numToRead);
+
+	for (auto index = end - numToRead; index != end; index++)
+	{
+		const auto& e = events[index & (BufferSize - 1)];
+
+		auto sequence = e.sequence.load(std::memory_order_acquire);
+
+		if (sequence != index + 1)
+			continue;
+
+		EventData d = { e.frame, e.scope, e.start, e.end, e.threadId };
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		// the slot was overwritten while we were copying it
+		if (e.sequence.load(std::memory_order_relaxed) != sequence)
+			continue;
+
+		list.add(d);
+	}
+
+	return list;
+}
+
+void mcl::Profiler::getStatistics(Statistics (&statistics)[numScopes]) const
+{
+	for (auto& s : statistics)
+		s = {};
+
+	auto list = getEvents();
+
+	if (list.isEmpty())
+		return;
+
+	double frameTimes[numScopes] = {};
+	bool usedInFrame[numScopes] = {};
+	auto frame = list.getFirst().frame;
+
+	auto flushFrame = [&]()
+	{
+		for (int i = 0; i < numScopes; i++)
+		{
+			if (!usedInFrame[i])
+				continue;
+
+			auto& s = statistics[i];
+			auto ms = frameTimes[i];
+
+			s.numFrames++;
+			s.lastMs = ms;
+			s.meanMs += ms;
+			s.maxMs = jmax(s.maxMs, ms);
+
+			int bucket = 0;
+
+			while (ms > getBucketLimit(bucket))
+				bucket++;
+
+			s.histogram[bucket]++;
+
+			frameTimes[i] = 0.0;
+			usedInFrame[i] = false;
+		}
+	};
+
+	for (const auto& e : list)
+	{
+		if (e.frame != frame)
+		{
+			flushFrame();
+			frame = e.frame;
+		}
+
+		frameTimes[e.scope] += Time::highResolutionTicksToSeconds(e.end - e.start) * 1000.0;
+		usedInFrame[e.scope] = true;
+	}
+
+	flushFrame();
+
+	for (auto& s : statistics)
+	{
+		if (s.numFrames > 0)
+			s.meanMs /= (double)s.numFrames;
+	}
+}
+
+void mcl::Profiler::paintOverlay(Graphics& g, Rectangle<float> area, Colour textColour) const
+{
+	Statistics statistics[numScopes];
+	getStatistics(statistics);
+
+	g.setFont(Font(Font::getDefaultMonospacedFontName(), 12.0f, Font::plain));
+
+	auto rowHeight = 16.0f;
+	auto header = area.removeFromTop(rowHeight);
+
+	g.setColour(textColour);
+	g.drawText(String("scope").paddedRight(' ', 12) + "  last    mean     max",
+			   header, Justification::centredLeft, false);
+
+	if (!isEnabled())
+	{
+		g.drawText("profiler disabled", area.removeFromTop(rowHeight), Justification::centredLeft, false);
+		return;
+	}
+
+	for (int i = 0; i < numScopes; i++)
+	{
+		const auto& s = statistics[i];
+		auto row = area.removeFromTop(rowHeight);
+
+		auto formatMs = [](double ms) { return String(ms, 2).paddedLeft(' ', 6) + " "; };
+
+		String text;
+		text << getScopeName((Scope)i).paddedRight(' ', 12);
+
+		if (s.numFrames > 0)
+			text << formatMs(s.lastMs) << formatMs(s.meanMs) << formatMs(s.maxMs);
+
+		g.setColour(textColour);
+		g.drawText(text, row, Justification::centredLeft, false);
+
+		if (s.numFrames == 0)
+			continue;
+
+		// Draw the histogram right of the numbers, one bar per bucket
+		auto histogramArea = row.removeFromRight(NumBuckets * 6.0f).reduced(0.0f, 2.0f);
+		auto barWidth = histogramArea.getWidth() / (float)NumBuckets;
+
+		int maxCount = 1;
+
+		for (auto c : s.histogram)
+			maxCount = jmax(maxCount, c);
+
+		for (int b = 0; b < NumBuckets; b++)
+		{
+			auto bar = histogramArea.removeFromLeft(barWidth).reduced(0.5f, 0.0f);
+			auto h = bar.getHeight() * (float)s.histogram[b] / (float)maxCount;
+
+			g.setColour(textColour.withAlpha(0.15f));
+			g.fillRect(bar);
+			g.setColour(textColour.withAlpha(0.7f));
+			g.fillRect(bar.removeFromBottom(h));
+		}
+	}
+}
+
+juce::var mcl::Profiler::createChromeTrace() const
+{
+	auto list = getEvents();
+
+	Array<var> traceEvents;
+	Array<pointer_sized_int> threadIds;
+
+	auto firstTick = std::numeric_limits<int64>::max();
+
+	for (const auto& e : list)
+		firstTick = jmin(firstTick, e.start);
+
+	auto toMicroSeconds = [](int64 ticks)
+	{
+		return Time::highResolutionTicksToSeconds(ticks) * 1000000.0;
+	};
+
+	for (const auto& e : list)
+	{
+		threadIds.addIfNotAlreadyThere(e.threadId);
+
+		DynamicObject::Ptr args = new DynamicObject();
+		args->setProperty("frame", (int)e.frame);
+
+		DynamicObject::Ptr te = new DynamicObject();
+		te->setProperty("name", getScopeName(e.scope));
+		te->setProperty("cat", "mcl_editor");
+		te->setProperty("ph", "X");
+		te->setProperty("ts", toMicroSeconds(e.start - firstTick));
+		te->setProperty("dur", toMicroSeconds(e.end - e.start));
+		te->setProperty("pid", 1);
+		te->setProperty("tid", threadIds.indexOf(e.threadId) + 1);
+		te->setProperty("args", var(args.get()));
+
+		traceEvents.add(var(te.get()));
+	}
+
+	DynamicObject::Ptr root = new DynamicObject();
+	root->setProperty("traceEvents", traceEvents);
+	root->setProperty("displayTimeUnit", "ms");
+
+	return var(root.get());
+}
+
+juce::Result mcl::Profiler::exportChromeTrace(const File& target) const
+{
+	auto json = JSON::toString(createChromeTrace(), true);
+
+	if (!target.replaceWithText(json))
+		return Result::fail("Can't write to " + target.getFullPathName());
+
+	return Result::ok();
+}
+
+
+}
@@ -0,0 +1,168 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+/**
+	A lightweight frame-time profiler for the editor.
+
+	The timed scopes write into a fixed size lock-free ring buffer, so it can be
+	left enabled in a release build without allocating or blocking the paint
+	routine (and it does nothing but check an atomic flag when it's disabled).
+
+	A frame starts with every TextEditor::paint() call, the events of the child
+	components that are painted afterwards are attributed to the same frame.
+
+	Use it like this:
+
+		void mcl::GutterComponent::paint(Graphics& g)
+		{
+			Profiler::ScopedTimer st(Profiler::Gutter);
+			...
+		}
+
+	The data can be displayed with paintOverlay() (the "Draw profiling info"
+	option in the editor's context menu) or exported as Chrome trace JSON that
+	can be loaded in chrome://tracing or https://ui.perfetto.dev.
+*/
+class Profiler
+{
+public:
+
+	enum Scope
+	{
+		Frame = 0,
+		Layout,
+		Tokenise,
+		GlyphDraw,
+		Gutter,
+		Highlight,
+		Caret,
+		Minimap,
+		numScopes
+	};
+
+	/** The number of events that the ring buffer can hold (must be a power of two). */
+	static constexpr int BufferSize = 8192;
+
+	/** The number of histogram buckets, see getBucketLimit(). */
+	static constexpr int NumBuckets = 8;
+
+	struct Statistics
+	{
+		int numFrames = 0;
+		double lastMs = 0.0;
+		double meanMs = 0.0;
+		double maxMs = 0.0;
+		int histogram[NumBuckets] = {};
+	};
+
+	/** The time measurement of a single scope. If the profiler is disabled, it does nothing. */
+	struct ScopedTimer
+	{
+		ScopedTimer(Scope s) noexcept :
+			scope(s),
+			start(getInstance().isEnabled() ? Time::getHighResolutionTicks() : 0)
+		{}
+
+		~ScopedTimer()
+		{
+			if (start != 0)
+				getInstance().addEvent(scope, start, Time::getHighResolutionTicks());
+		}
+
+	private:
+
+		const Scope scope;
+		const int64 start;
+
+		JUCE_DECLARE_NON_COPYABLE(ScopedTimer);
+	};
+
+	/** Returns the profiler instance that is shared by all editors. */
+	static Profiler& getInstance();
+
+	static String getScopeName(Scope s);
+
+	/** Returns the upper bound of the given histogram bucket in milliseconds (the last bucket catches the rest). */
+	static double getBucketLimit(int bucketIndex);
+
+	void setEnabled(bool shouldBeEnabled);
+
+	bool isEnabled() const noexcept { return enabled.load(std::memory_order_relaxed); }
+
+	/** Starts a new frame. This is called at the beginning of TextEditor::paint(). */
+	void startFrame() noexcept;
+
+	/** Removes all recorded events. */
+	void clear();
+
+	/** Calculates the per frame statistics of the events that are still in the ring buffer. */
+	void getStatistics(Statistics (&statistics)[numScopes]) const;
+
+	/** Draws a table with the frame times and histograms into the given area. */
+	void paintOverlay(Graphics& g, Rectangle<float> area, Colour textColour) const;
+
+	/** Writes the recorded events into a Chrome trace event JSON file. */
+	Result exportChromeTrace(const File& target) const;
+
+	/** Creates the Chrome trace event JSON (an object with a traceEvents array). */
+	var createChromeTrace() const;
+
+private:
+
+	Profiler();
+
+	struct Event
+	{
+		/** The index of the write operation + 1 after the event was written. Zero means that the slot is being written. */
+		std::atomic<uint32> sequence = { 0 };
+
+		uint32 frame = 0;
+		Scope scope = Frame;
+		int64 start = 0;
+		int64 end = 0;
+		pointer_sized_int threadId = 0;
+	};
+
+	struct EventData
+	{
+		uint32 frame;
+		Scope scope;
+		int64 start;
+		int64 end;
+		pointer_sized_int threadId;
+	};
+
+	void addEvent(Scope s, int64 start, int64 end) noexcept;
+
+	/** Copies the valid events from the ring buffer (oldest first). */
+	Array<EventData> getEvents() const;
+
+	std::atomic<bool> enabled = { false };
+	std::atomic<uint32> writeIndex = { 0 };
+	std::atomic<uint32> currentFrame = { 0 };
+	std::atomic<uint32> clearIndex = { 0 };
+
+	Event events[BufferSize];
+
+	JUCE_DECLARE_NON_COPYABLE(Profiler);
+};
+
+
+}
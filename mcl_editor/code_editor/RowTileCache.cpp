@@ -0,0 +1,198 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+mcl::RowTileCache::RowTileCache(const TextDocument& document_) :
+	document(document_)
+{
+}
+
+void mcl::RowTileCache::draw(Graphics& g, const AffineTransform& transform, int width, int height, int generation, const RenderFunction& renderRows)
+{
+	auto physicalScale = g.getInternalContext().getPhysicalPixelScaleFactor();
+	auto scale = transform.getScaleFactor();
+	auto inverse = transform.inverted();
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	auto getRows = [&](Rectangle<float> area)
+	{
+		return document.getRangeOfRowsIntersecting(area.transformedBy(inverse)).getIntersectionWith({ 0, document.getNumRows() });
+	};
+
+	// the columns are as wide as the view in scaled document space
+	auto getColumns = [&](Rectangle<float> area)
+	{
+		auto x1 = (int)std::floor((area.getX() - transform.getTranslationX()) / (float)width);
+		auto x2 = (int)std::floor((area.getRight() - transform.getTranslationX()) / (float)width);
+		return Range<int>(x1, x2 + 1);
+	};
+
+	auto getTileRows = [&](int index)
+	{
+		return Range<int>(index * RowsPerTile, jmin((index + 1) * RowsPerTile, document.getNumRows()));
+	};
+
+	auto getTileHeight = [&](Range<int> tileRows)
+	{
+		auto top = document.getVerticalPosition(tileRows.getStart(), TextDocument::Metric::top);
+		auto bottom = document.getVerticalPosition(tileRows.getEnd() - 1, TextDocument::Metric::bottom);
+		return jmax(0, (int)std::ceil((bottom - top) * scale * physicalScale));
+	};
+
+	auto tileWidth = roundToInt((float)width * physicalScale);
+
+	// The memory budget is the size of the tiles that cover the whole view plus one screen
+	int64 maxNumBytes = (int64)tileWidth * (int64)roundToInt((float)height * physicalScale) * 4;
+
+	{
+		auto viewArea = Rectangle<float>(0.0f, 0.0f, (float)width, (float)height);
+		auto viewRows = getRows(viewArea);
+
+		if (!viewRows.isEmpty())
+		{
+			auto numColumns = (int64)getColumns(viewArea).getLength();
+
+			for (int index = viewRows.getStart() / RowsPerTile; index <= (viewRows.getEnd() - 1) / RowsPerTile; index++)
+				maxNumBytes += numColumns * (int64)tileWidth * (int64)getTileHeight(getTileRows(index)) * 4;
+		}
+	}
+
+	auto clipArea = g.getClipBounds().toFloat();
+	auto rows = getRows(clipArea);
+
+	if (rows.isEmpty())
+		return;
+
+	auto columns = getColumns(clipArea);
+
+	frameCounter++;
+
+	for (int index = rows.getStart() / RowsPerTile; index <= (rows.getEnd() - 1) / RowsPerTile; index++)
+	{
+		auto tileRows = getTileRows(index);
+
+		auto top = document.getVerticalPosition(tileRows.getStart(), TextDocument::Metric::top);
+		auto bottom = document.getVerticalPosition(tileRows.getEnd() - 1, TextDocument::Metric::bottom);
+
+		// all rows are folded
+		if (bottom <= top)
+			continue;
+
+		Key key;
+		key.scale = scale;
+		key.physicalScale = physicalScale;
+		key.width = width;
+		key.generation = generation;
+		key.layoutHash = document.getLayoutHash(tileRows);
+
+		auto tileTop = top * scale;
+
+		for (int column = columns.getStart(); column < columns.getEnd(); column++)
+		{
+			auto tile = getTile(index, column);
+			tile->lastUsed = frameCounter;
+
+			auto tileLeft = (float)(column * width);
+
+			if (!(tile->key == key) || tile->image.isNull())
+			{
+				auto h = getTileHeight(tileRows);
+
+				if (tile->image.isNull() || tile->image.getWidth() != tileWidth || tile->image.getHeight() != h)
+					tile->image = Image(Image::ARGB, jmax(1, tileWidth), jmax(1, h), true);
+				else
+					tile->image.clear(tile->image.getBounds());
+
+				tile->key = key;
+
+				Graphics tg(tile->image);
+				tg.addTransform(AffineTransform::scale(physicalScale));
+				tg.addTransform(AffineTransform::scale(scale).translated(-tileLeft, -tileTop));
+
+				Rectangle<float> documentArea(tileLeft / scale, top, (float)width / scale, bottom - top);
+				renderRows(tg, documentArea);
+			}
+
+			// snap the tile to the physical pixel grid, otherwise it would be resampled
+			auto x = std::round((tileLeft + transform.getTranslationX()) * physicalScale) / physicalScale;
+			auto y = std::round((tileTop + transform.getTranslationY()) * physicalScale) / physicalScale;
+
+			g.drawImageTransformed(tile->image, AffineTransform::scale(1.0f / physicalScale).translated(x, y));
+		}
+	}
+
+	removeUnusedTiles(maxNumBytes);
+}
+
+void mcl::RowTileCache::clear()
+{
+	tiles.clear();
+}
+
+juce::int64 mcl::RowTileCache::getNumBytes() const
+{
+	int64 numBytes = 0;
+
+	for (auto t : tiles)
+		numBytes += (int64)sizeof(Tile) + getImageBytes(t->image);
+
+	return numBytes;
+}
+
+mcl::RowTileCache::Tile* mcl::RowTileCache::getTile(int row, int column)
+{
+	for (auto t : tiles)
+	{
+		if (t->row == row && t->column == column)
+			return t;
+	}
+
+	auto t = new Tile();
+	t->row = row;
+	t->column = column;
+	return tiles.add(t);
+}
+
+void mcl::RowTileCache::removeUnusedTiles(int64 maxNumBytes)
+{
+	int64 numBytes = 0;
+
+	for (auto t : tiles)
+		numBytes += getImageBytes(t->image);
+
+	// remove the least recently used tiles, but never the ones of the current frame
+	while (numBytes > maxNumBytes)
+	{
+		int oldestIndex = -1;
+
+		for (int i = 0; i < tiles.size(); i++)
+		{
+			if (tiles[i]->lastUsed != frameCounter && (oldestIndex == -1 || tiles[i]->lastUsed < tiles[oldestIndex]->lastUsed))
+				oldestIndex = i;
+		}
+
+		if (oldestIndex == -1)
+			break;
+
+		numBytes -= getImageBytes(tiles[oldestIndex]->image);
+		tiles.remove(oldestIndex);
+	}
+}
+
+
+}
@@ -0,0 +1,100 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+/** A cache of rendered text in tiles of RowsPerTile rows.
+
+	Every tile is an image of its rows at the current zoom and display scale. The
+	tiles are as wide as the editor and are placed at fixed document positions, so
+	scrolling in any direction just draws the cached tiles at a different position
+	and only the tiles that were scrolled into view need to be rendered. A tile is
+	rendered again if the zoom, the width, the generation that the editor passes in
+	(which changes with every edit) or the layout of one of its rows is different.
+
+	The memory is limited to the tiles of the visible area and about one more
+	screen. The least recently used tiles are removed first.
+
+	The tiles are transparent, so the background and the selection highlights
+	can be drawn below them.
+*/
+class RowTileCache
+{
+public:
+
+	/** Renders the text of the rows within the area (in document space). The graphics
+		context has the transform from document space to the tile image.
+	*/
+	using RenderFunction = std::function<void(Graphics& g, Rectangle<float> documentArea)>;
+
+	static constexpr int RowsPerTile = 32;
+
+	RowTileCache(const TextDocument& document);
+
+	/** Draws the visible rows into the graphics context (which must not have the view transform).
+		The tiles that are not cached are rendered with the given function. The width and
+		the height are the size of the view, which determine the memory budget.
+	*/
+	void draw(Graphics& g, const AffineTransform& transform, int width, int height, int generation, const RenderFunction& renderRows);
+
+	void clear();
+
+	int getNumTiles() const { return tiles.size(); }
+
+	int64 getNumBytes() const;
+
+private:
+
+	struct Key
+	{
+		bool operator==(const Key& other) const
+		{
+			return scale == other.scale && physicalScale == other.physicalScale &&
+				   width == other.width && generation == other.generation && layoutHash == other.layoutHash;
+		}
+
+		float scale = 0.0f;
+		float physicalScale = 0.0f;
+		int width = 0;
+		int generation = 0;
+		int64 layoutHash = 0;
+	};
+
+	struct Tile
+	{
+		int row = -1;		///< the index of the first row / RowsPerTile
+		int column = 0;		///< the horizontal position in multiples of the width (in scaled document space)
+		Key key;
+		Image image;
+		uint32 lastUsed = 0;
+	};
+
+	Tile* getTile(int row, int column);
+	void removeUnusedTiles(int64 maxNumBytes);
+
+	static int64 getImageBytes(const Image& img) { return (int64)img.getWidth() * (int64)img.getHeight() * 4; }
+
+	const TextDocument& document;
+	OwnedArray<Tile> tiles;
+	uint32 frameCounter = 0;
+
+	JUCE_DECLARE_NON_COPYABLE(RowTileCache);
+};
+
+
+}
@@ -181,36 +181,6 @@ void mcl::Selection::push(Point<int>& index) const
 
 
 
-//==============================================================================
-class mcl::Transaction::Undoable : public UndoableAction
-{
-public:
-	Undoable(TextDocument& document, Callback callback, Transaction forward)
-		: document(document)
-		, callback(callback)
-		, forward(forward) {}
-
-	bool perform() override
-	{
-		callback(reverse = document.fulfill(forward));
-		return true;
-	}
-
-	bool undo() override
-	{
-		callback(forward = document.fulfill(reverse));
-		return true;
-	}
-
-	TextDocument& document;
-	Callback callback;
-	Transaction forward;
-	Transaction reverse;
-};
-
-
-
-
 //==============================================================================
 mcl::Transaction mcl::Transaction::accountingForSpecialCharacters(const TextDocument& document) const
 {
@@ -237,11 +207,6 @@ mcl::Transaction mcl::Transaction::accountingForSpecialCharacters(const TextDocu
 	return t;
 }
 
-UndoableAction* mcl::Transaction::on(TextDocument& document, Callback callback)
-{
-	return new Undoable(document, callback, *this);
-}
-
 
 
 
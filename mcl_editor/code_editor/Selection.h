@@ -162,7 +162,6 @@ struct mcl::Selection
 //==============================================================================
 struct mcl::Transaction
 {
-	using Callback = std::function<void(const Transaction&)>;
 	enum class Direction { forward, reverse };
 
 	/** Return a copy of this transaction, corrected for delete and backspace
@@ -171,19 +170,10 @@ struct mcl::Transaction
 	 */
 	Transaction accountingForSpecialCharacters(const TextDocument& document) const;
 
-	/** Return an undoable action, whose perform method thill fulfill this
-		transaction, and which caches the reciprocal transaction to be
-		issued in the undo method.
-	 */
-	juce::UndoableAction* on(TextDocument& document, Callback callback);
-
 	mcl::Selection selection;
 	juce::String content;
 	juce::Rectangle<float> affectedArea;
 	Direction direction = Direction::forward;
-
-private:
-	class Undoable;
 };
 
 
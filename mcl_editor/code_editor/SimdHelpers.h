@@ -0,0 +1,123 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+
+#if MCL_SIMD_AVAILABLE
+
+//==============================================================================
+/**
+	A thin wrapper around a 16 byte SIMD register (SSE2 or NEON) with the few
+	operations that the text scanning kernels need. All comparisons return a
+	byte mask (0xFF for true, 0x00 for false) that can be turned into a bitmask
+	with toBitMask() where bit n corresponds to byte n.
+
+	The range checks use signed comparisons on SSE2, so they are only valid for
+	ASCII bounds (< 0x80), which is all we need.
+*/
+struct ByteBlock
+{
+	static constexpr int Size = 16;
+
+#if MCL_SIMD_SSE2
+	using NativeType = __m128i;
+
+	static NativeType load(const void* p) noexcept { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+	static void store(void* p, NativeType v) noexcept { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+	static NativeType broadcast(uint8 v) noexcept { return _mm_set1_epi8((char)v); }
+	static NativeType equal(NativeType a, NativeType b) noexcept { return _mm_cmpeq_epi8(a, b); }
+	static NativeType bitOr(NativeType a, NativeType b) noexcept { return _mm_or_si128(a, b); }
+	static NativeType bitAnd(NativeType a, NativeType b) noexcept { return _mm_and_si128(a, b); }
+
+	static NativeType inRange(NativeType v, uint8 lowest, uint8 highest) noexcept
+	{
+		jassert(highest < 0x7F);
+		return _mm_and_si128(_mm_cmpgt_epi8(v, broadcast((uint8)(lowest - 1))),
+			                 _mm_cmplt_epi8(v, broadcast((uint8)(highest + 1))));
+	}
+
+	/** Returns a bitmask with the highest bit of each byte. */
+	static uint32 toBitMask(NativeType v) noexcept { return (uint32)_mm_movemask_epi8(v); }
+
+#elif MCL_SIMD_NEON
+	using NativeType = uint8x16_t;
+
+	static NativeType load(const void* p) noexcept { return vld1q_u8(static_cast<const uint8*>(p)); }
+	static void store(void* p, NativeType v) noexcept { vst1q_u8(static_cast<uint8*>(p), v); }
+	static NativeType broadcast(uint8 v) noexcept { return vdupq_n_u8(v); }
+	static NativeType equal(NativeType a, NativeType b) noexcept { return vceqq_u8(a, b); }
+	static NativeType bitOr(NativeType a, NativeType b) noexcept { return vorrq_u8(a, b); }
+	static NativeType bitAnd(NativeType a, NativeType b) noexcept { return vandq_u8(a, b); }
+
+	static NativeType inRange(NativeType v, uint8 lowest, uint8 highest) noexcept
+	{
+		return vandq_u8(vcgeq_u8(v, vdupq_n_u8(lowest)), vcleq_u8(v, vdupq_n_u8(highest)));
+	}
+
+	/** Returns a bitmask with the highest bit of each byte (like _mm_movemask_epi8). */
+	static uint32 toBitMask(NativeType v) noexcept
+	{
+		static const int8 shifts[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+		auto bits = vshlq_u8(vshrq_n_u8(v, 7), vld1q_s8(shifts));
+
+		auto lo = vget_low_u8(bits);
+		auto hi = vget_high_u8(bits);
+
+		lo = vpadd_u8(lo, lo); lo = vpadd_u8(lo, lo); lo = vpadd_u8(lo, lo);
+		hi = vpadd_u8(hi, hi); hi = vpadd_u8(hi, hi); hi = vpadd_u8(hi, hi);
+
+		return (uint32)vget_lane_u8(lo, 0) | ((uint32)vget_lane_u8(hi, 0) << 8);
+	}
+#endif
+
+	/** Returns true if all 16 bytes are 7-bit ASCII characters. */
+	static bool isAscii(NativeType v) noexcept { return toBitMask(v) == 0; }
+};
+
+#endif
+
+#if MCL_SIMD_AVX2
+
+//==============================================================================
+/**
+	The 32 byte AVX2 version of the ByteBlock (without the range checks). The kernels
+	that are templated on the block type use this if the module is compiled with AVX2.
+*/
+struct WideByteBlock
+{
+	static constexpr int Size = 32;
+
+	using NativeType = __m256i;
+
+	static NativeType load(const void* p) noexcept { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+	static void store(void* p, NativeType v) noexcept { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+	static NativeType broadcast(uint8 v) noexcept { return _mm256_set1_epi8((char)v); }
+	static NativeType equal(NativeType a, NativeType b) noexcept { return _mm256_cmpeq_epi8(a, b); }
+	static NativeType bitOr(NativeType a, NativeType b) noexcept { return _mm256_or_si256(a, b); }
+	static NativeType bitAnd(NativeType a, NativeType b) noexcept { return _mm256_and_si256(a, b); }
+
+	/** Returns a bitmask with the highest bit of each byte. */
+	static uint32 toBitMask(NativeType v) noexcept { return (uint32)_mm256_movemask_epi8(v); }
+
+	static bool isAscii(NativeType v) noexcept { return toBitMask(v) == 0; }
+};
+
+#endif
+
+
+}
@@ -20,12 +20,36 @@ void mcl::TextDocument::replaceAll(const String& content)
 {
 	lines.clear();
 
-	for (const auto& line : StringArray::fromLines(content))
+	auto utf8 = content.toRawUTF8();
+
+	LineScanner scanner;
+	scanner.scan(utf8, (int)content.getNumBytesAsUTF8());
+
+	for (int i = 0; i < scanner.getNumLines(); i++)
 	{
-		lines.add(line);
+		const auto& l = scanner.getLine(i);
+		lines.add(String::fromUTF8(utf8 + l.start, l.numBytes), l);
 	}
 }
 
+void mcl::TextDocument::addMemoryUsage(MemoryUsage& m) const
+{
+	// The CodeDocument keeps a String and the line metadata for every line
+	static constexpr int64 CodeDocumentLineSize = sizeof(String) + 3 * sizeof(int) + sizeof(void*);
+
+	m.add(MemoryUsage::Document, (int64)doc.getNumCharacters() + (int64)doc.getNumLines() * CodeDocumentLineSize);
+	m.add(MemoryUsage::Document, MemoryUsage::getArrayBytes(selections) + MemoryUsage::getArrayBytes(searchResults));
+	m.add(MemoryUsage::Document, lineOffsets.getNumBytes());
+	m.add(MemoryUsage::Glyphs, MemoryUsage::getArrayBytes(rowPositions));
+
+	lines.addMemoryUsage(m);
+
+	// every range is referenced in the list of all ranges and in the children of its parent
+	m.add(MemoryUsage::Folding, (int64)foldManager.all.size() * (int64)(sizeof(FoldableLineRange) + 2 * sizeof(void*)) +
+								MemoryUsage::getArrayBytes(foldManager.foldedPositions) +
+								(int64)(foldManager.lineStates.getHighestBit() + 1) / 8);
+}
+
 int mcl::TextDocument::getNumRows() const
 {
 	return lines.size();
@@ -33,7 +57,7 @@ int mcl::TextDocument::getNumRows() const
 
 int mcl::TextDocument::getNumColumns(int row) const
 {
-	return lines[row].length();
+	return lines.getLength(row);
 }
 
 float mcl::TextDocument::getVerticalPosition(int row, Metric metric) const
@@ -48,7 +72,7 @@ float mcl::TextDocument::getVerticalPosition(int row, Metric metric) const
 	float lineHeight = getCharacterRectangle().getHeight() + gap;
 
 	if (isPositiveAndBelow(row, lines.size()))
-		lineHeight = lines.lines[row]->height + gap;
+		lineHeight = lines.getHeight(row) + gap;
 
 	switch (metric)
 	{
@@ -112,14 +136,8 @@ Rectangle<float> mcl::TextDocument::getBounds() const
 	{
 		int maxX = 0;
 
-		for (auto l : lines.lines)
-		{
-			for (int i = 0; i < l->charactersPerLine.size(); i++)
-			{
-				maxX = jmax(maxX, l->charactersPerLine[i]);
-			}
-
-		}
+		for (int i = 0; i < lines.size(); i++)
+			maxX = jmax(maxX, lines.getWidthInColumns(i));
 
 		auto bottom = getVerticalPosition(lines.size() - 1, Metric::bottom);
 		auto right = maxX * getCharacterRectangle().getWidth() + TEXT_INDENT;
@@ -160,7 +178,9 @@ RectangleList<float> mcl::TextDocument::getBoundsOnRow(int row, Range<int> colum
 		columns.setStart(jmax(columns.getStart(), 0));
 		auto l = lines.lines[row];
 
-		auto boundsToUse = l->characterBounds;
+		// this doesn't use the layout, so monospaced lines don't have to be shaped
+		auto boundsToUse = lines.characterRectangle;
+		auto lastLine = jmax(1, roundToInt(lines.getHeight(row) / font.getHeight())) - 1;
 
 		if (boundsToUse.isEmpty())
 			boundsToUse = { 0.0f, 0.0f, font.getStringWidthFloat(" "), font.getHeight() };
@@ -169,17 +189,17 @@ RectangleList<float> mcl::TextDocument::getBoundsOnRow(int row, Range<int> colum
 		float xPos = TEXT_INDENT;
 		float gap = lineSpacing * font.getHeight() - font.getHeight();
 
-		auto length = l->string.length();
+		auto length = l->length;
 
 		for (int i = columns.getStart(); i < columns.getEnd(); i++)
 		{
-			auto p = l->getPositionInLine(i, m);
+			auto p = lines.getPositionInLine(row, i, m);
 			auto cBound = boundsToUse.translated(xPos + p.y * boundsToUse.getWidth(), yPos + p.x * boundsToUse.getHeight());
 
-			if (p.x == l->charactersPerLine.size() - 1)
+			if (p.x == lastLine)
 				cBound = cBound.withHeight(cBound.getHeight() + gap);
 
-			bool isTab = isPositiveAndBelow(i, length) && l->string[i] == '\t';
+			bool isTab = isPositiveAndBelow(i, length) && l->getCharacter(i) == '\t';
 
 			if (isTab)
 			{
@@ -248,21 +268,134 @@ GlyphArrangement mcl::TextDocument::getGlyphsForRow(int row, int token, bool wit
 		withTrailingSpace);
 }
 
+mcl::GlyphArrangementArray::GlyphRun mcl::TextDocument::getGlyphRunForRow(int row, int token, bool withTrailingSpace, int chunk) const
+{
+	return lines.getGlyphRun(row,
+		getVerticalPosition(row, Metric::baseline),
+		token,
+		withTrailingSpace,
+		chunk);
+}
+
 GlyphArrangement mcl::TextDocument::findGlyphsIntersecting(Rectangle<float> area, int token) const
 {
 	auto range = getRangeOfRowsIntersecting(area);
-	auto rows = Array<RowData>();
 	auto glyphs = GlyphArrangement();
 
 	for (int n = range.getStart(); n < range.getEnd(); ++n)
 	{
-		if(!foldManager.isFolded(n))
+		if (foldManager.isFolded(n))
+			continue;
+
+		if (DEBUG_TOKENS)
+		{
 			glyphs.addGlyphArrangement(getGlyphsForRow(n, token));
+			continue;
+		}
+
+		auto chunks = lines.getChunksIntersecting(n, area.getHorizontalRange());
+
+		for (int c = chunks.getStart(); c < chunks.getEnd(); c++)
+			getGlyphRunForRow(n, token, false, c).addTo(glyphs);
 	}
 
 	return glyphs;
 }
 
+mcl::TextDocument::FrameGlyphs mcl::TextDocument::collectGlyphsIntersecting(Rectangle<float> area, int numTokens, FrameArena& arena) const
+{
+	using Row = GlyphArrangementArray::GlyphRun;
+
+	FrameGlyphs fg;
+	fg.numTokens = jmax(0, numTokens);
+
+	auto range = getRangeOfRowsIntersecting(area).getIntersectionWith({ 0, getNumRows() });
+	auto counts = arena.allocate<int>(fg.numTokens + 1);
+	int numRows = 0;
+
+	// long lines only add the chunks in the area, so a row can have more than one run
+	for (int n = range.getStart(); n < range.getEnd(); ++n)
+	{
+		if (!foldManager.isFolded(n))
+			numRows += lines.getChunksIntersecting(n, area.getHorizontalRange()).getLength();
+	}
+
+	auto rows = arena.allocate<Row>(numRows);
+	numRows = 0;
+
+	auto getToken = [&](const Row& r, int i)
+	{
+		return fg.numTokens == 1 ? 0 : r.getToken(i);
+	};
+
+	// count the glyphs per token
+	for (int n = range.getStart(); n < range.getEnd(); ++n)
+	{
+		if (foldManager.isFolded(n))
+			continue;
+
+		auto chunks = lines.getChunksIntersecting(n, area.getHorizontalRange());
+
+		for (int c = chunks.getStart(); c < chunks.getEnd(); c++)
+		{
+			auto& r = rows[numRows++];
+			r = getGlyphRunForRow(n, -1, false, c);
+
+			for (int i = 0; i < r.size(); i++)
+			{
+				auto t = getToken(r, i);
+
+				if (isPositiveAndBelow(t, fg.numTokens) && !r.getGlyph(i).isWhitespace())
+					counts[t + 1]++;
+			}
+		}
+	}
+
+	for (int t = 0; t < fg.numTokens; t++)
+		counts[t + 1] += counts[t];
+
+	auto glyphs = arena.allocate<FrameGlyphs::Ref>(counts[fg.numTokens]);
+
+	fg.glyphs = glyphs;
+	fg.tokenStarts = counts;
+
+	// the write positions start at the token starts and end at the start of the next token
+	auto positions = arena.allocate<int>(fg.numTokens);
+
+	for (int t = 0; t < fg.numTokens; t++)
+		positions[t] = counts[t];
+
+	for (int r = 0; r < numRows; r++)
+	{
+		const auto& row = rows[r];
+
+		for (int i = 0; i < row.size(); i++)
+		{
+			auto t = getToken(row, i);
+			auto& glyph = row.getGlyph(i);
+
+			if (isPositiveAndBelow(t, fg.numTokens) && !glyph.isWhitespace())
+				glyphs[positions[t]++] = { &glyph, row.offset };
+		}
+	}
+
+	return fg;
+}
+
+void mcl::TextDocument::FrameGlyphs::draw(Graphics& g, const Colour* tokenColours) const
+{
+	for (int t = 0; t < numTokens; t++)
+	{
+		if (tokenStarts[t] == tokenStarts[t + 1])
+			continue;
+
+		g.setColour(tokenColours[t]);
+
+		for (int i = tokenStarts[t]; i < tokenStarts[t + 1]; i++)
+			glyphs[i].glyph->draw(g, AffineTransform::translation(glyphs[i].offset.x, glyphs[i].offset.y));
+	}
+}
+
 juce::Range<int> mcl::TextDocument::getRangeOfRowsIntersecting(juce::Rectangle<float> area) const
 {
 	if (rowPositions.isEmpty())
@@ -296,7 +429,10 @@ Array<mcl::TextDocument::RowData> mcl::TextDocument::findRowsIntersecting(Rectan
 		RowData data;
 		data.rowNumber = n;
 
-		data.bounds = getBoundsOnRow(n, Range<int>(0, getNumColumns(n)), GlyphArrangementArray::ReturnBeyondLastCharacter);
+		// Without the horizontal extent, the first character is enough to get the vertical position
+		auto numColumns = computeHorizontalExtent ? getNumColumns(n) : jmin(1, getNumColumns(n));
+
+		data.bounds = getBoundsOnRow(n, Range<int>(0, numColumns), GlyphArrangementArray::ReturnBeyondLastCharacter);
 
 		if (data.bounds.isEmpty())
 		{
@@ -316,12 +452,36 @@ Array<mcl::TextDocument::RowData> mcl::TextDocument::findRowsIntersecting(Rectan
 	return rows;
 }
 
+juce::int64 mcl::TextDocument::getLayoutHash(Range<int> rows) const
+{
+	uint64 h = 14695981039346656037ull;
+
+	auto add = [&h](uint64 v) { h = (h ^ v) * 1099511628211ull; };
+	auto addFloat = [&add](float v) { add((uint64)roundToInt(v * 100.0f)); };
+
+	add((uint64)lines.maxLineWidth);
+	addFloat(lines.characterRectangle.getWidth());
+	addFloat(font.getHeight());
+	addFloat(lineSpacing);
+
+	rows = rows.getIntersectionWith({ 0, jmin(lines.size(), rowPositions.size()) });
+
+	for (int i = rows.getStart(); i < rows.getEnd(); i++)
+	{
+		add(lines.getId(i));
+		addFloat(lines.getHeight(i));
+		addFloat(rowPositions[i]);
+		add(foldManager.isFolded(i) ? 1 : 0);
+	}
+
+	return (int64)h;
+}
+
 Point<int> mcl::TextDocument::findIndexNearestPosition(Point<float> position) const
 {
 	position = position.translated(getCharacterRectangle().getWidth() * 0.5f, 0.0f);
 
 	auto gap = font.getHeight() * lineSpacing - font.getHeight();
-	float yPos = gap / 2.0f;
 
 	if (position.y > rowPositions.getLast() + getRowHeight())
 	{
@@ -329,64 +489,49 @@ Point<int> mcl::TextDocument::findIndexNearestPosition(Point<float> position) co
 		if (x >= 0)
 			return { x, getNumColumns(x) - 1 };
 	}
-		
-
-	for (int l = 0; l < getNumRows(); l++)
-	{
-		auto line = lines.lines[l];
 
-		if (foldManager.isFolded(l))
-			continue;
-
-		Range<float> p(yPos - gap / 2.0f, yPos + line->height + gap / 2.0f);
+	// The rows are sorted by their position and a folded row has the same position as
+	// the next one, so the row is the last one that starts above the position
+	auto l = (int)(std::upper_bound(rowPositions.begin(), rowPositions.end(), position.y) - rowPositions.begin()) - 1;
+	l = jmin(l, getNumRows() - 1);
 
-		if (p.contains(position.y))
-		{
-			auto glyphs = getGlyphsForRow(l, -1, true);
+	while (l >= 0 && foldManager.isFolded(l))
+		l--;
 
-			int numGlyphs = glyphs.getNumGlyphs();
-			auto col = numGlyphs;
+	if (l < 0)
+		return { 0, 0 };
 
-			for (int n = 0; n < numGlyphs; ++n)
-			{
-				auto b = glyphs.getBoundingBox(n, 1, true).expanded(0.0f, gap / 2.f);
-
-				if (b.contains(position))
-				{
-					col = n+1;
-					break;
-				}
-			}
+	if (lines.fixedPitch)
+	{
+		// Every glyph is a column wide, so the column can be calculated from the
+		// position and looked up in the layout instead of testing all glyph bounds
+		auto lineHeight = font.getHeight();
+		auto numWrappedLines = jmax(1, roundToInt(lines.getHeight(l) / lineHeight));
+		auto y = position.y - getVerticalPosition(l, Metric::ascent);
 
-			return { l, col -1 };
-		}
+		auto wrappedLine = jlimit(0, numWrappedLines - 1, (int)std::floor(y / lineHeight));
+		auto column = jmax(0, (int)std::floor((position.x - TEXT_INDENT) / getCharacterRectangle().getWidth()));
 
-		yPos = p.getEnd();
+		return { l, lines.getGlyphIndexAt(l, wrappedLine, column) };
 	}
 
-	return { 0, 0 };
+	auto glyphs = getGlyphRunForRow(l, -1, true);
 
-	jassertfalse;
+	int numGlyphs = glyphs.size();
+	auto col = numGlyphs;
 
-	auto lineHeight = font.getHeight() * lineSpacing;
-	auto row = jlimit(0, jmax(getNumRows() - 1, 0), int(position.y / lineHeight));
-	auto col = 0;
-	auto glyphs = getGlyphsForRow(row);
-
-	if (position.x > 0.f)
+	for (int n = 0; n < numGlyphs; ++n)
 	{
-		col = glyphs.getNumGlyphs();
+		auto b = glyphs.getBounds(n).expanded(0.0f, gap / 2.f);
 
-		for (int n = 0; n < glyphs.getNumGlyphs(); ++n)
+		if (b.contains(position))
 		{
-			if (glyphs.getBoundingBox(n, 1, true).getHorizontalRange().contains(position.x))
-			{
-				col = n;
-				break;
-			}
+			col = n+1;
+			break;
 		}
 	}
-	return { row, col };
+
+	return { l, col -1 };
 }
 
 Point<int> mcl::TextDocument::getEnd() const
@@ -653,11 +798,11 @@ juce_wchar mcl::TextDocument::getCharacter(Point<int> index) const
 	//jassert(0 <= index.x && index.x <= lines.size());
 	
 
-	if (index == getEnd() || index.y >= lines[index.x].length())
+	if (index == getEnd() || index.y >= lines.getLength(index.x))
 	{
 		return '\n';
 	}
-	return lines[index.x].getCharPointer()[index.y];
+	return lines.getCharacter(index.x, index.y);
 }
 
 const mcl::Selection& mcl::TextDocument::getSelection(int index) const
@@ -697,10 +842,12 @@ mcl::Transaction mcl::TextDocument::fulfill(const Transaction& transaction)
 
 	const auto t = transaction.accountingForSpecialCharacters(*this);
 	const auto s = t.selection.oriented();
-	const auto L = getSelectionContent(s.horizontallyMaximized(*this));
-	const auto i = s.head.y;
-	const auto j = L.lastIndexOf("\n") + s.tail.y + 1;
-	const auto M = L.substring(0, i) + t.content + L.substring(j);
+
+	// The replaced range is resolved to character offsets, so the removed text
+	// is the only copy that is made (it's needed for the reciprocal)
+	const auto start = getCharacterOffset(s.head);
+	const auto end = getCharacterOffset(s.tail);
+	auto removed = doc.getTextBetween(CodeDocument::Position(doc, s.head.x, s.head.y), CodeDocument::Position(doc, s.tail.x, s.tail.y));
 
 	for (auto& existingSelection : selections)
 	{
@@ -708,27 +855,263 @@ mcl::Transaction mcl::TextDocument::fulfill(const Transaction& transaction)
 		existingSelection.pushBy(Selection(t.content).startingFrom(s.head));
 	}
 
-	auto sPos = CodeDocument::Position(doc, s.head.x, s.head.y);
-	auto ePos = CodeDocument::Position(doc, s.tail.x, s.tail.y);
-
-	shouldBe = M;
-
-	ScopedValueSetter<bool> svs(checkThis, true);
-
-	doc.replaceSection(sPos.getPosition(), ePos.getPosition(), t.content);
+	doc.replaceSection(start, end, t.content);
 
 	using D = Transaction::Direction;
 	auto inf = std::numeric_limits<float>::max();
 
 	Transaction r;
 	r.selection = Selection(t.content).startingFrom(s.head);
-	r.content = L.substring(i, j);
+	r.content = removed;
 	r.affectedArea = Rectangle<float>(0, 0, inf, inf);
 	r.direction = t.direction == D::forward ? D::reverse : D::forward;
 
 	return r;
 }
 
+juce::Array<mcl::Transaction> mcl::TextDocument::fulfill(const Array<Transaction>& transactions, Array<UndoHistory::Delta>* appliedDeltas)
+{
+	cachedBounds = {}; // invalidate the bounds
+
+	struct Edit
+	{
+		int index;			// the position in the transaction list
+		Selection s;		// the oriented range that is replaced
+		String content;
+		Transaction::Direction direction;
+		int start;			// the character offsets in the CodeDocument
+		int end;
+		String removed;
+	};
+
+	auto isBefore = [](Point<int> a, Point<int> b)
+	{
+		return a.x < b.x || (a.x == b.x && a.y < b.y);
+	};
+
+	Array<Edit> edits;
+	edits.ensureStorageAllocated(transactions.size());
+
+	for (int i = 0; i < transactions.size(); i++)
+	{
+		auto t = transactions.getReference(i).accountingForSpecialCharacters(*this);
+		edits.add({ i, t.selection.oriented(), t.content, t.direction, 0, 0, {} });
+	}
+
+	struct EditSorter
+	{
+		static int compareElements(const Edit& a, const Edit& b)
+		{
+			if (a.s < b.s) return -1;
+			if (b.s < a.s) return 1;
+			return a.index - b.index;
+		}
+	};
+
+	EditSorter sorter;
+	edits.sort(sorter);
+
+	// Clip overlapping ranges (eg. a backspace with two adjacent carets)
+	for (int i = 1; i < edits.size(); i++)
+	{
+		auto prevTail = edits.getReference(i - 1).s.tail;
+		auto& s = edits.getReference(i).s;
+
+		if (isBefore(s.head, prevTail))
+		{
+			s.head = prevTail;
+
+			if (isBefore(s.tail, s.head))
+				s.tail = s.head;
+		}
+	}
+
+	for (auto& e : edits)
+	{
+		e.start = getCharacterOffset(e.s.head);
+		e.end = getCharacterOffset(e.s.tail);
+		e.removed = doc.getTextBetween(CodeDocument::Position(doc, e.s.head.x, e.s.head.y), CodeDocument::Position(doc, e.s.tail.x, e.s.tail.y));
+	}
+
+	Array<Replacement> replacements;
+	replacements.ensureStorageAllocated(edits.size());
+
+	for (const auto& e : edits)
+		replacements.add({ e.start, e.end, e.content });
+
+	replaceSections(replacements);
+
+	// The deltas are stored as if the edits were applied from the bottom up,
+	// so the offset of every delta is valid when it's applied or reverted
+	if (appliedDeltas != nullptr)
+	{
+		for (int i = edits.size() - 1; i >= 0; i--)
+		{
+			const auto& e = edits.getReference(i);
+
+			if (e.removed.isNotEmpty() || e.content.isNotEmpty())
+				appliedDeltas->add({ e.start, e.removed, e.content });
+		}
+	}
+
+	// Calculate the new ranges in one sweep: every edit shifts the rows below it and the
+	// columns that follow it on its last row.
+	using D = Transaction::Direction;
+	auto inf = std::numeric_limits<float>::max();
+
+	Array<Transaction> reciprocals;
+	reciprocals.insertMultiple(0, Transaction(), edits.size());
+
+	int rowShift = 0;
+	int colShift = 0;
+	int lastTailRow = -1;
+
+	for (const auto& e : edits)
+	{
+		Point<int> head(e.s.head.x + rowShift, e.s.head.y);
+
+		if (e.s.head.x == lastTailRow)
+			head.y += colShift;
+
+		Transaction r;
+		r.selection = Selection(e.content).startingFrom(head);
+		r.content = e.removed;
+		r.affectedArea = Rectangle<float>(0, 0, inf, inf);
+		r.direction = e.direction == D::forward ? D::reverse : D::forward;
+
+		rowShift += (r.selection.tail.x - r.selection.head.x) - (e.s.tail.x - e.s.head.x);
+		colShift = r.selection.tail.y - e.s.tail.y;
+		lastTailRow = e.s.tail.x;
+
+		reciprocals.setUnchecked(e.index, r);
+	}
+
+	return reciprocals;
+}
+
+void mcl::TextDocument::applyDeltas(const Array<UndoHistory::Delta>& deltas, bool revert)
+{
+	cachedBounds = {};
+
+	// The deltas of a multi caret edit are in the order they were applied (from the bottom
+	// up), so they are all relative to the text before the edit and can be merged
+	bool canBeMerged = deltas.size() > 1;
+
+	for (int i = 1; canBeMerged && i < deltas.size(); i++)
+		canBeMerged = deltas[i].offset + deltas[i].removed.length() <= deltas[i - 1].offset;
+
+	if (canBeMerged)
+	{
+		Array<Replacement> replacements;
+		replacements.ensureStorageAllocated(deltas.size());
+
+		// the ranges of reverted deltas are moved by the deltas above them
+		int shift = 0;
+
+		for (int i = deltas.size() - 1; i >= 0; i--)
+		{
+			const auto& d = deltas.getReference(i);
+			auto numRemoved = d.removed.length();
+			auto numInserted = d.inserted.length();
+
+			if (revert)
+				replacements.add({ d.offset + shift, d.offset + shift + numInserted, d.removed });
+			else
+				replacements.add({ d.offset, d.offset + numRemoved, d.inserted });
+
+			shift += numInserted - numRemoved;
+		}
+
+		replaceSections(replacements);
+		return;
+	}
+
+	{
+		ScopedValueSetter<bool> svs(deferRowPositionUpdate, true);
+
+		if (revert)
+		{
+			for (int i = deltas.size() - 1; i >= 0; i--)
+			{
+				const auto& d = deltas.getReference(i);
+				doc.replaceSection(d.offset, d.offset + d.inserted.length(), d.removed);
+			}
+		}
+		else
+		{
+			for (const auto& d : deltas)
+				doc.replaceSection(d.offset, d.offset + d.removed.length(), d.inserted);
+		}
+	}
+
+	rebuildRowPositions();
+}
+
+void mcl::TextDocument::replaceSections(const Array<Replacement>& replacements)
+{
+	if (replacements.isEmpty())
+		return;
+
+	auto firstRow = lineOffsets.getRow(replacements.getFirst().start);
+
+	{
+		ScopedValueSetter<bool> svs(deferRowPositionUpdate, true);
+
+		// Apply the replacements from the last to the first, so the offsets of the
+		// ones above stay valid. Replacements that are only a few characters apart
+		// are merged, but the text between distant carets is never copied.
+		int groupEnd = replacements.size();
+
+		while (groupEnd > 0)
+		{
+			int groupStart = groupEnd - 1;
+
+			while (groupStart > 0)
+			{
+				const auto& prev = replacements.getReference(groupStart - 1);
+				const auto& next = replacements.getReference(groupStart);
+				jassert(prev.end <= next.start);
+
+				if (next.start - prev.end > MaxReplacementGapToMerge)
+					break;
+
+				--groupStart;
+			}
+
+			const auto& first = replacements.getReference(groupStart);
+
+			if (groupEnd - groupStart == 1)
+			{
+				doc.replaceSection(first.start, first.end, first.text);
+			}
+			else
+			{
+				String text;
+
+				for (int i = groupStart; i < groupEnd; i++)
+				{
+					const auto& r = replacements.getReference(i);
+					text << r.text;
+
+					if (i + 1 < groupEnd)
+					{
+						auto nextStart = replacements.getReference(i + 1).start;
+
+						if (nextStart > r.end)
+							text << doc.getTextBetween(CodeDocument::Position(doc, r.end), CodeDocument::Position(doc, nextStart));
+					}
+				}
+
+				doc.replaceSection(first.start, replacements.getReference(groupEnd - 1).end, text);
+			}
+
+			groupEnd = groupStart;
+		}
+	}
+
+	rebuildRowPositions(firstRow);
+}
+
 void mcl::TextDocument::clearTokens(juce::Range<int> rows)
 {
 	for (int n = rows.getStart(); n < rows.getEnd(); ++n)
@@ -748,7 +1131,29 @@ void mcl::TextDocument::applyTokens(juce::Range<int> rows, const juce::Array<Sel
 				lines.applyTokens(n, zone);
 			}
 		}
+
+		if (isPositiveAndBelow(n, lines.size()))
+			lines.metadata.clearFlags(n, GlyphArrangementArray::LineMetadata::TokensDirty);
+	}
+}
+
+bool mcl::TextDocument::hasDirtyTokens(juce::Range<int> rows) const
+{
+	rows = rows.getIntersectionWith({ 0, lines.size() });
+
+	for (int n = rows.getStart(); n < rows.getEnd(); ++n)
+	{
+		if (lines.metadata.hasFlag(n, GlyphArrangementArray::LineMetadata::TokensDirty))
+			return true;
 	}
+
+	return false;
+}
+
+void mcl::TextDocument::invalidateTokens()
+{
+	for (int n = 0; n < lines.size(); ++n)
+		lines.metadata.setFlags(n, GlyphArrangementArray::LineMetadata::TokensDirty);
 }
 
 juce::Array<juce::Line<float>> mcl::TextDocument::getUnderlines(const Selection& s, Metric m) const
@@ -771,7 +1176,7 @@ juce::Array<juce::Line<float>> mcl::TextDocument::getUnderlines(const Selection&
 			if (l == lineRange.getEnd() - 1)
 				right = o.tail.y;
 
-			auto ul = lines.lines[l]->getUnderlines({ left, right }, !s.isSingular());
+			auto ul = lines.getUnderlines(l, { left, right }, !s.isSingular());
 
 			float delta = 0.0f;
 
@@ -804,6 +1209,7 @@ mcl::TextDocument::TextDocument(CodeDocument& doc_) :
 	foldManager(doc_)
 {
 	doc.setDisableUndo(true);
+	lineOffsets.rebuild(doc);
 
 	addFoldListener(this);
 }
@@ -396,12 +396,23 @@ public:
 	/** Set the font to be applied to all text. */
 	void setFont(juce::Font fontToUse)
 	{
+		auto fontChanged = !(fontToUse == font);
 
 		font = fontToUse; lines.font = fontToUse;
 		lines.characterRectangle = { 0.0f, 0.0f, font.getStringWidthFloat(" "), font.getHeight() };
+		lines.fixedPitch = GlyphArrangementArray::isFixedPitch(font);
+
+		// the layouts depend on the font (and long lines are only chunked for monospaced fonts)
+		if (fontChanged)
+		{
+			lines.invalidate({});
+			rebuildRowPositions();
+		}
 	}
 
-	/** Replace the whole document content. */
+	/** Replace the whole document content. The lines are split with a LineScanner, so the
+		text is only scanned once.
+	*/
 	void replaceAll(const juce::String& content);
 
 	/** Replace the list of selections with a new one. */
@@ -435,6 +446,11 @@ public:
 	/** Get the number of columns in the given row. */
 	int getNumColumns(int row) const;
 
+	/** Returns the number of characters in the longest line (without the line break). Unlike
+		CodeDocument::getMaximumLineLength(), this doesn't need to be recalculated after an insertion.
+	*/
+	int getMaximumLineLength() const { return lines.getMaximumLength(); }
+
 	/** Return the vertical position of a metric on a row. */
 	float getVerticalPosition(int row, Metric metric) const;
 
@@ -471,12 +487,44 @@ public:
 	 */
 	juce::GlyphArrangement getGlyphsForRow(int row, int token = -1, bool withTrailingSpace = false) const;
 
+	/** Returns a view of the glyphs of the row at their document position. This doesn't copy
+		the glyphs, so use this for painting and hit testing.
+	*/
+	GlyphArrangementArray::GlyphRun getGlyphRunForRow(int row, int token = -1, bool withTrailingSpace = false, int chunk = 0) const;
+
+	/** Returns the chunks of the row that intersect the horizontal range (see GlyphArrangementArray::isChunked()). */
+	Range<int> getChunksIntersecting(int row, Range<float> xRange) const { return lines.getChunksIntersecting(row, xRange); }
+
 	/** Return all glyphs whose bounding boxes intersect the given area. This method
 		may be generous (including glyphs that don't intersect). If token != -1, then
 		only glyphs with that token mask are returned.
 	 */
 	juce::GlyphArrangement findGlyphsIntersecting(juce::Rectangle<float> area, int token = -1) const;
 
+	/** The glyphs of the rows in an area sorted by their token. This points to the line layouts and
+		the lists are allocated in a FrameArena, so it's only valid until the arena is reset.
+	*/
+	struct FrameGlyphs
+	{
+		struct Ref
+		{
+			const PositionedGlyph* glyph;
+			Point<float> offset;
+		};
+
+		/** Draws the glyphs of every token with the colour at the token index. */
+		void draw(Graphics& g, const Colour* tokenColours) const;
+
+		const Ref* glyphs = nullptr;
+		const int* tokenStarts = nullptr;
+		int numTokens = 0;
+	};
+
+	/** Collects the glyphs of the rows in the area without creating a GlyphArrangement. Glyphs with a
+		token >= numTokens are skipped, if numTokens is 1 all glyphs are sorted into the first token.
+	*/
+	FrameGlyphs collectGlyphsIntersecting(juce::Rectangle<float> area, int numTokens, FrameArena& arena) const;
+
 	/** Return the range of rows intersecting the given rectangle. */
 	juce::Range<int> getRangeOfRowsIntersecting(juce::Rectangle<float> area) const;
 
@@ -487,6 +535,12 @@ public:
 	juce::Array<RowData> findRowsIntersecting(juce::Rectangle<float> area,
 		bool computeHorizontalExtent = false) const;
 
+	/** Returns a hash of the layout of the given rows. It changes if one of the rows is
+		edited, moved, folded or wrapped differently, so you can use it to invalidate
+		data that was derived from the row geometry.
+	*/
+	int64 getLayoutHash(juce::Range<int> rows) const;
+
 	/** Find the row and column index nearest to the given position. */
 	juce::Point<int> findIndexNearestPosition(juce::Point<float> position) const;
 
@@ -553,23 +607,76 @@ public:
 	 */
 	juce::String getSelectionContent(Selection selection) const;
 
+	/** Returns the character offset of the (row, column) index in the CodeDocument. */
+	int getCharacterOffset(juce::Point<int> index) const
+	{
+		return lineOffsets.getOffset(index);
+	}
+
+	/** Returns the (row, column) index of the character offset in the CodeDocument. */
+	juce::Point<int> getIndexForCharacterOffset(int offset) const
+	{
+		return lineOffsets.getIndex(offset);
+	}
+
+	/** Returns a number that changes with every edit. An edit can change the tokens of
+		all rows after it, so this can be used to invalidate rendered text.
+	*/
+	int getTokenGeneration() const { return tokenGeneration; }
+
+	/** Returns the line start table of the CodeDocument. */
+	const LineOffsetTable& getLineOffsets() const { return lineOffsets; }
+
 	/** Apply a transaction to the document, and return its reciprocal. The selection
 		identified in the transaction does not need to exist in the document.
 	 */
 	Transaction fulfill(const Transaction& transaction);
 
+	/** Apply a list of transactions (eg. one per caret) in a single sweep and return their
+		reciprocals in the same order. The edits are applied from the last to the first, and
+		edits that are at most MaxReplacementGapToMerge characters apart are merged into one
+		replacement. Every remaining replacement is a separate change of the CodeDocument
+		that shifts the lines and the line offset table after it, so N distant carets cost
+		O(N * L) where L is the number of lines, but the row positions are only rebuilt once.
+		Overlapping ranges are clipped so every character is only removed once. Unlike the
+		single transaction version, this doesn't modify the selections of the document, the
+		caller is supposed to set them from the result.
+
+		If appliedDeltas is not null, the replacements are added in the order they were
+		applied so that they can be stored in the UndoHistory.
+	 */
+	juce::Array<Transaction> fulfill(const juce::Array<Transaction>& transactions,
+									 juce::Array<UndoHistory::Delta>* appliedDeltas = nullptr);
+
+	/** Applies the deltas in the given order, or reverts them in the reverse order. If the
+		deltas come from a multi caret edit (descending and not overlapping), they are
+		applied like in fulfill() with a single rebuild of the row positions.
+	*/
+	void applyDeltas(const juce::Array<UndoHistory::Delta>& deltas, bool revert);
+
 	/* Reset glyph token values on the given range of rows. */
 	void clearTokens(juce::Range<int> rows);
 
 	/** Apply tokens from a set of zones to a range of rows. */
 	void applyTokens(juce::Range<int> rows, const juce::Array<Selection>& zones);
 
+	/** Returns true if one of the rows has changed since its tokens were applied. */
+	bool hasDirtyTokens(juce::Range<int> rows) const;
+
+	/** Marks the tokens of all rows as dirty (eg. if the token colours depend on something else than the text). */
+	void invalidateTokens();
+
+	/** Sets the width for the line breaks (-1 disables them). This doesn't shape the text
+		again, the rows of every line are calculated from the cached glyph advances when the
+		row positions are rebuilt, and the glyphs are only moved when a line is drawn.
+	*/
 	void setMaxLineWidth(int maxWidth)
 	{
 		if (maxWidth != lines.maxLineWidth)
 		{
-			lines.maxLineWidth = maxWidth;
-			invalidate({});
+			lines.setMaxLineWidth(maxWidth);
+			cachedBounds = {};
+			rebuildRowPositions();
 		}
 	}
 
@@ -587,58 +694,99 @@ public:
 		rebuildRowPositions();
 	}
 
-	void rebuildRowPositions()
+	/** Recalculates the row positions from the given row. The rows above it must not have
+		changed (eg. when lines are appended, only the new rows are calculated).
+	*/
+	void rebuildRowPositions(int firstRow = 0)
 	{
-		rowPositions.clearQuick();
-		rowPositions.ensureStorageAllocated(lines.size());
-
-		float yPos = 0.0f;
+		firstRow = jlimit(0, jmin(rowPositions.size(), lines.size()), firstRow);
 
 		float gap = getCharacterRectangle().getHeight() * (lineSpacing - 1.f) * 0.5f;
+		float yPos = 0.0f;
 
-		for (int i = 0; i < lines.size(); i++)
+		if (firstRow > 0)
 		{
-			rowPositions.add(yPos);
+			yPos = rowPositions[firstRow - 1];
+
+			if (!foldManager.isFolded(firstRow - 1))
+				yPos += lines.getHeight(firstRow - 1) + gap;
+		}
 
-			auto l = lines.lines[i];
+		rowPositions.removeRange(firstRow, rowPositions.size() - firstRow);
+		rowPositions.ensureStorageAllocated(lines.size());
 
-			lines.ensureValid(i);
+		for (int i = firstRow; i < lines.size(); i++)
+		{
+			rowPositions.add(yPos);
 
 			if(!foldManager.isFolded(i))
-				yPos += l->height + gap;
+				yPos += lines.getHeight(i) + gap;
 		}
 	}
 
 	void codeChanged(bool wasInserted, int startIndex, int endIndex)
 	{
-		CodeDocument::Position start(getCodeDocument(), startIndex);
-		CodeDocument::Position end(getCodeDocument(), endIndex);
+		// the offset table still has the state before the edit (which is the same up to the start index)
+		auto firstLine = lineOffsets.getRow(startIndex);
+		auto delta = doc.getNumLines() - lines.size();
+		auto numCharactersDelta = wasInserted ? endIndex - startIndex : startIndex - endIndex;
 
-		auto sameLine = start.getLineNumber() == end.getLineNumber();
-		auto existingLine = isPositiveAndBelow(start.getLineNumber(), lines.size());
+		tokenGeneration++;
 
-		auto b = getCodeDocument().getTextBetween(start, end);
+		// The edited line is replaced: an insertion adds delta lines after it,
+		// a deletion merges (1 - delta) old lines into one.
+		auto numToRemove = wasInserted ? 1 : 1 - delta;
+		auto numToInsert = numToRemove + delta;
 
-		bool includesLineBreak = b.contains("\n");
+		auto firstChangedRow = firstLine;
 
-		lines.lines.clearQuick();
-		lines.lines.ensureStorageAllocated(doc.getNumLines());
+		if (numToRemove < 1 || numToInsert < 0 || !isPositiveAndBelow(firstLine, lines.size()) || firstLine + numToRemove > lines.size())
+		{
+			firstChangedRow = 0;
 
-		jassertfalse;
-#if 0
-		for (int i = 0; i < doc.getNumLines(); i++)
+			lines.clear();
+
+			for (int i = 0; i < doc.getNumLines(); i++)
+				lines.add(getLineWithoutLinebreak(i));
+
+			lineOffsets.rebuild(doc);
+		}
+		else
 		{
-			lines.add(doc.getLineWithoutLinebreak(i));
+			lines.removeRange(firstLine, numToRemove);
+
+			for (int i = 0; i < numToInsert; i++)
+				lines.insert(firstLine + i, getLineWithoutLinebreak(firstLine + i));
+
+			lineOffsets.update(doc, firstLine, numToRemove, numToInsert, numCharactersDelta);
 		}
-#endif
 
-		rebuildRowPositions();
+		jassert(lines.size() == doc.getNumLines());
+
+		cachedBounds = {};
+
+		if (!deferRowPositionUpdate)
+			rebuildRowPositions(firstChangedRow);
+	}
+
+	String getLineWithoutLinebreak(int lineIndex) const
+	{
+		return doc.getLine(lineIndex).trimCharactersAtEnd("\r\n");
 	}
 
 	/** returns the amount of lines occupied by the row. This can be > 1 when the line-break is active. */
 	int getNumLinesForRow(int rowIndex) const
 	{
-		return roundToInt(lines.lines[rowIndex]->height / font.getHeight());
+		return roundToInt(lines.getHeight(rowIndex) / font.getHeight());
+	}
+
+	/** Returns the line entries of the document. An entry is replaced instead of changed when
+		the text of its line changes, so the strings of the returned entries can be read on
+		another thread.
+	*/
+	ReferenceCountedArray<GlyphArrangementArray::Entry> getLineEntries() const
+	{
+		return lines.lines;
 	}
 
 	float getFontHeight() const { return font.getHeight(); };
@@ -688,17 +836,38 @@ public:
 		return searchResults;
 	}
 
+	/** Adds the estimated memory usage of the text, the layout and the fold ranges. */
+	void addMemoryUsage(MemoryUsage& m) const;
+
 private:
 
+	/** A replacement of the character range [start, end) of the CodeDocument. */
+	struct Replacement
+	{
+		int start;
+		int end;
+		String text;
+	};
+
+	/** Replacements that are closer than this are applied as a single replacement. */
+	static constexpr int MaxReplacementGapToMerge = 32;
+
+	/** Applies sorted, non-overlapping replacements from the last to the first one and
+		rebuilds the row positions once afterwards. Replacements with a small gap are
+		merged, so adjacent carets only cause a single CodeDocument change.
+	*/
+	void replaceSections(const Array<Replacement>& replacements);
+
+	bool deferRowPositionUpdate = false;
+
 	Array<Selection> searchResults;
 
 	FoldableLineRange::Holder foldManager;
 
 	Array<float> rowPositions;
 
-	bool checkThis = false;
-	String shouldBe;
-	String isReally;
+	LineOffsetTable lineOffsets;
+	int tokenGeneration = 0;
 
 	friend class TextEditor;
 
@@ -30,8 +30,12 @@ mcl::TextEditor::TextEditor(CodeDocument& codeDoc)
 , treeview(document)
 , foldMap(document)
 , tooltipManager(*this)
+, undoHistory(document)
+, tiles(document)
+, loader(codeDoc)
 {
-	tokenCollection.addTokenProvider(new SimpleDocumentTokenProvider(codeDoc));
+	tokenCollection.addTokenProvider(new SimpleDocumentTokenProvider(document));
+	setUndoMemoryBudget(DefaultUndoMemoryBudget);
 
     lastTransactionTime = Time::getApproximateMillisecondCounter();
     document.setSelections ({ Selection() });
@@ -92,9 +96,38 @@ mcl::TextEditor::TextEditor(CodeDocument& codeDoc)
 
 mcl::TextEditor::~TextEditor()
 {
+#if MCL_ENABLE_OPEN_GL
+	glRenderer = nullptr;
+#endif
+
 	docRef.removeListener(this);
 }
 
+mcl::MemoryUsage mcl::TextEditor::getMemoryUsage() const
+{
+	MemoryUsage m;
+
+	document.addMemoryUsage(m);
+	map.addMemoryUsage(m);
+	gutter.addMemoryUsage(m);
+	tokenCollection.addMemoryUsage(m);
+
+	m.add(MemoryUsage::UndoHistory, undoHistory.getNumBytes());
+	m.add(MemoryUsage::Glyphs, tiles.getNumBytes() + frameArena.getNumBytes() + MemoryUsage::getArrayBytes(tokenZones));
+
+#if MCL_ENABLE_OPEN_GL
+	if (glRenderer != nullptr)
+		m.add(MemoryUsage::Glyphs, glRenderer->getNumBytes());
+#endif
+
+	return m;
+}
+
+void mcl::TextEditor::setUndoMemoryBudget(int64 maxNumBytes)
+{
+	undoHistory.setMemoryBudget(maxNumBytes);
+}
+
 void mcl::TextEditor::setFont (Font font)
 {
     document.setFont (font);
@@ -103,10 +136,24 @@ void mcl::TextEditor::setFont (Font font)
 
 void mcl::TextEditor::setText (const String& text)
 {
+    // a file that is still loading would append its remaining batches to the new text
+    loader.cancel();
     document.replaceAll (text);
     repaint();
 }
 
+bool mcl::TextEditor::loadFile (const File& file)
+{
+    undoHistory.clear();
+
+    if (! loader.load (file))
+        return false;
+
+    document.setSelections ({ Selection() });
+    repaint();
+    return true;
+}
+
 void TextEditor::scrollToLine(float centerLine, bool scrollToLine)
 {
 	auto W = document.getBounds().getWidth();
@@ -186,6 +233,8 @@ void mcl::TextEditor::updateViewTransform()
 
 
 	map.setVisibleRange(rows);
+
+	document.lines.releaseLayoutsOutside(rows);
 	
 
     repaint();
@@ -293,32 +342,32 @@ void mcl::TextEditor::resized()
 
 void mcl::TextEditor::paint (Graphics& g)
 {
-    auto start = Time::getMillisecondCounterHiRes();
-    
-
-    String renderSchemeString;
-
-	renderTextUsingGlyphArrangement(g);
+    auto& profiler = Profiler::getInstance();
+    profiler.startFrame();
 
-    lastTimeInPaint = Time::getMillisecondCounterHiRes() - start;
-    accumulatedTimeInPaint += lastTimeInPaint;
-    numPaintCalls += 1;
+    // the OpenGL renderer draws the background, the highlights and the text before the components
+    if (! useOpenGLRendering)
+    {
+        Profiler::ScopedTimer st (Profiler::Frame);
+        renderTextUsingGlyphArrangement (g);
+    }
 
     if (drawProfilingInfo)
     {
         String info;
-        info += "paint mode         : " + renderSchemeString + "\n";
         info += "cache glyph bounds : " + String (document.lines.cacheGlyphArrangement ? "yes" : "no") + "\n";
         info += "core graphics      : " + String (allowCoreGraphics ? "yes" : "no") + "\n";
         info += "opengl             : " + String (useOpenGLRendering ? "yes" : "no") + "\n";
         info += "syntax highlight   : " + String (enableSyntaxHighlighting ? "yes" : "no") + "\n";
-        info += "mean render time   : " + String (accumulatedTimeInPaint / numPaintCalls) + " ms\n";
-        info += "last render time   : " + String (lastTimeInPaint) + " ms\n";
-        info += "tokeniser time     : " + String (lastTokeniserTime) + " ms\n";
 
-        g.setColour (findColour (CodeEditorComponent::defaultTextColourId));
+        auto textColour = findColour (CodeEditorComponent::defaultTextColourId);
+        auto area = Rectangle<float> ((float)getWidth() - 320.0f, 10.0f, 300.0f, 220.0f);
+
+        g.setColour (textColour);
         g.setFont (Font ("Courier New", 12, 0));
-        g.drawMultiLineText (info, getWidth() - 280, 10, 280);
+        g.drawMultiLineText (info, (int)area.getX(), (int)area.getY(), (int)area.getWidth());
+
+        profiler.paintOverlay (g, area.withTrimmedTop (70.0f), textColour);
     }
 
 	if (showClosures && document.getSelection(0).isSingular())
@@ -351,10 +400,6 @@ void mcl::TextEditor::paint (Graphics& g)
 
 	for (auto w : warnings)
 		w->paintLines(g, transform, Colours::yellow);
-
-#if PROFILE_PAINTS
-    std::cout << "[TextEditor::paint] " << lastTimeInPaint << std::endl;
-#endif
 }
 
 void mcl::TextEditor::paintOverChildren (Graphics& g)
@@ -376,10 +421,15 @@ void mcl::TextEditor::mouseDown (const MouseEvent& e)
 #if JUCE_MAC
         menu.addItem (5, "Allow Core Graphics", true, allowCoreGraphics, nullptr);
 #endif
+#if MCL_ENABLE_OPEN_GL
+        menu.addItem (6, "Use OpenGL renderer", true, useOpenGLRendering, nullptr);
+#endif
 
         menu.addItem (7, "Syntax highlighting", true, enableSyntaxHighlighting, nullptr);
         menu.addItem (8, "Draw profiling info", true, drawProfilingInfo, nullptr);
+        menu.addItem (12, "Export profiling data as Chrome trace...", Profiler::getInstance().isEnabled());
         menu.addItem (9, "Debug tokens", true, DEBUG_TOKENS, nullptr);
+        menu.addItem (13, "Cache rendered rows", true, useTileCache, nullptr);
 		menu.addItem(10, "Enable line breaks", true, linebreakEnabled);
 		menu.addItem(11, "Enable code map", true, map.isVisible());
 
@@ -390,13 +440,17 @@ void mcl::TextEditor::mouseDown (const MouseEvent& e)
             case 3: renderScheme = RenderScheme::usingGlyphArrangement; break;
             case 4: document.lines.cacheGlyphArrangement = ! document.lines.cacheGlyphArrangement; break;
             case 5: allowCoreGraphics = ! allowCoreGraphics; break;
+            case 6: setUseOpenGLRendering (! useOpenGLRendering); break;
             case 7: enableSyntaxHighlighting = ! enableSyntaxHighlighting; break;
-            case 8: drawProfilingInfo = ! drawProfilingInfo; break;
+            case 8: drawProfilingInfo = ! drawProfilingInfo; Profiler::getInstance().setEnabled (drawProfilingInfo || PROFILE_PAINTS); break;
             case 9: DEBUG_TOKENS = ! DEBUG_TOKENS; break;
 			case 10: linebreakEnabled = !linebreakEnabled; refreshLineWidth();
-			case 11: map.setVisible(!map.isVisible()); resized();
+			case 11: map.setVisible(!map.isVisible()); resized(); break;
+			case 12: exportProfilingData(); break;
+            case 13: useTileCache = ! useTileCache; break;
         }
 
+        tiles.clear();
         resetProfilingData();
         repaint();
         return;
@@ -939,8 +993,8 @@ bool mcl::TextEditor::keyPressed (const KeyPress& key)
     if (key == KeyPress ('e', ModifierKeys::commandModifier, 0)) return expand (Target::token);
     if (key == KeyPress ('l', ModifierKeys::commandModifier, 0)) return expand (Target::line);
     if (key == KeyPress ('u', ModifierKeys::commandModifier, 0)) return addSelectionAtNextMatch();
-    if (key == KeyPress ('z', ModifierKeys::commandModifier, 0)) return undo.undo();
-    if (key == KeyPress ('r', ModifierKeys::commandModifier, 0)) return undo.redo();
+    if (key == KeyPress ('z', ModifierKeys::commandModifier, 0)) return performUndo (true);
+    if (key == KeyPress ('r', ModifierKeys::commandModifier, 0)) return performUndo (false);
 
     if (key == KeyPress ('x', ModifierKeys::commandModifier, 0))
     {
@@ -1063,36 +1117,56 @@ bool mcl::TextEditor::keyPressed (const KeyPress& key)
 
 bool mcl::TextEditor::insert (const juce::String& content)
 {
+    // Typing without a pause is merged into one undo step (if the edits continue each other)
     double now = Time::getApproximateMillisecondCounter();
+    auto canMerge = now < lastTransactionTime + 1000;
+    lastTransactionTime = now;
 
-    if (now > lastTransactionTime + 400)
-    {
-        lastTransactionTime = Time::getApproximateMillisecondCounter();
-        undo.beginNewTransaction();
-    }
-    
-    for (int n = 0; n < document.getNumSelections(); ++n)
+    // All carets are edited with a single transaction list, so this is one undo step
+    // and the document is only updated once.
+    Array<Transaction> transactions;
+    transactions.ensureStorageAllocated (document.getNumSelections());
+
+    for (const auto& s : document.getSelections())
     {
         Transaction t;
         t.content = content;
-        t.selection = document.getSelection (n);
-        
-        auto callback = [this, n] (const Transaction& r)
+        t.selection = s;
+        transactions.add (t);
+    }
+
+    auto selectionsBefore = document.getSelections();
+    Array<UndoHistory::Delta> deltas;
+    Array<Transaction> reciprocals;
+
+    {
+        ScopedValueSetter<bool> svs (skipTextUpdate, true);
+        reciprocals = document.fulfill (transactions, &deltas);
+    }
+
+    Array<Selection> newSelections;
+    newSelections.ensureStorageAllocated (reciprocals.size());
+
+    Rectangle<float> affectedArea;
+
+    for (const auto& r : reciprocals)
+    {
+        switch (r.direction) // NB: switching on the direction of the reciprocal here
         {
-            switch (r.direction) // NB: switching on the direction of the reciprocal here
-            {
-                case Transaction::Direction::forward: document.setSelection (n, r.selection); break;
-                case Transaction::Direction::reverse: document.setSelection (n, r.selection.tail); break;
-            }
+            case Transaction::Direction::forward: newSelections.add (r.selection); break;
+            case Transaction::Direction::reverse: newSelections.add (Selection (r.selection.tail)); break;
+        }
 
-            if (! r.affectedArea.isEmpty())
-            {
-                repaint (r.affectedArea.transformedBy (transform).getSmallestIntegerContainer());
-            }
-        };
-        undo.perform (t.on (document, callback));
+        affectedArea = affectedArea.getUnion (r.affectedArea);
     }
-	
+
+    document.setSelections (newSelections);
+    undoHistory.record (deltas, selectionsBefore, newSelections, canMerge);
+
+    if (! affectedArea.isEmpty())
+        repaint (affectedArea.transformedBy (transform).getSmallestIntegerContainer());
+
+    updateAfterTextChange();
 	translateToEnsureCaretIsVisible();
     updateSelections();
 
@@ -1101,6 +1175,35 @@ bool mcl::TextEditor::insert (const juce::String& content)
     return true;
 }
 
+bool mcl::TextEditor::performUndo (bool isUndo)
+{
+    bool ok;
+    Array<Selection> selectionsToRestore;
+
+    {
+        // the text change callbacks of the individual edits are skipped
+        ScopedValueSetter<bool> svs (skipTextUpdate, true);
+        ok = isUndo ? undoHistory.undo (selectionsToRestore) : undoHistory.redo (selectionsToRestore);
+    }
+
+    if (! ok)
+        return false;
+
+    // don't merge the next edit into the step before the undo
+    lastTransactionTime = 0.0;
+
+    if (! selectionsToRestore.isEmpty())
+        document.setSelections (selectionsToRestore);
+
+    repaint();
+
+    updateAfterTextChange();
+    translateToEnsureCaretIsVisible();
+    updateSelections();
+
+    return ok;
+}
+
 MouseCursor mcl::TextEditor::getMouseCursor()
 {
     return getMouseXYRelative().x < gutter.getGutterWidth() ? MouseCursor::NormalCursor : MouseCursor::IBeamCursor;
@@ -1116,57 +1219,145 @@ void mcl::TextEditor::renderTextUsingGlyphArrangement (juce::Graphics& g)
 
 	highlight.paintHighlight(g);
 
-    if (enableSyntaxHighlighting)
+    if (useTileCache)
     {
-        auto rows = document.getRangeOfRowsIntersecting (g.getClipBounds().toFloat());
+        g.restoreState();
 
+        // only the rows that are not in a cached tile are rendered
+        tiles.draw (g, transform, getWidth(), getHeight(), document.getTokenGeneration(), [this] (Graphics& tg, Rectangle<float> area)
+        {
+            renderRows (tg, area);
+        });
 
-		rows.setStart(jmax(0, rows.getStart() - 20));
-
-        auto index = Point<int> (rows.getStart(), 0);
-        
+        return;
+    }
 
-        auto it = TextDocument::Iterator (document, index);
-        auto previous = it.getIndex();
-        auto zones = Array<Selection>();
-        auto start = Time::getMillisecondCounterHiRes();
+    renderRows (g, g.getClipBounds().toFloat());
+    g.restoreState();
+}
 
-        while (it.getIndex().x < rows.getEnd() && ! it.isEOF())
-        {
-            auto tokenType = CppTokeniserFunctions::readNextToken (it);
-            zones.add (Selection (previous, it.getIndex()).withStyle (tokenType));
-            previous = it.getIndex();
-        }
+void mcl::TextEditor::renderRows (Graphics& g, Rectangle<float> area)
+{
+    // everything that is allocated for this pass is released here
+    frameArena.reset();
 
-		for (auto& z : zones)
-		{
-			if (deactivatesLines.contains(z.tail.x+1))
-				z.token = colourScheme.types.size() - 1;
-		}
+    if (enableSyntaxHighlighting)
+    {
+        updateTokens (area);
 
-        document.clearTokens (rows);
-        document.applyTokens (rows, zones);
+        Profiler::ScopedTimer st (Profiler::GlyphDraw);
 
-        lastTokeniserTime = Time::getMillisecondCounterHiRes() - start;
+        auto numTokens = colourScheme.types.size();
 
-        for (int n = 0; n < colourScheme.types.size(); ++n)
+        // the debug tokens are drawn instead of the text, so they need the glyph arrangements
+        if (DEBUG_TOKENS)
         {
-            g.setColour (colourScheme.types[n].colour);
-            document.findGlyphsIntersecting (g.getClipBounds().toFloat(), n).draw (g);
+            for (int n = 0; n < numTokens; ++n)
+            {
+                g.setColour (colourScheme.types[n].colour);
+                document.findGlyphsIntersecting (area, n).draw (g);
+            }
+
+            return;
         }
+
+        auto colours = frameArena.allocate<Colour> (numTokens);
+
+        for (int n = 0; n < numTokens; ++n)
+            colours[n] = colourScheme.types[n].colour;
+
+        document.collectGlyphsIntersecting (area, numTokens, frameArena).draw (g, colours);
     }
     else
     {
-        lastTokeniserTime = 0.f;
-        document.findGlyphsIntersecting (g.getClipBounds().toFloat()).draw (g);
+        Profiler::ScopedTimer st (Profiler::GlyphDraw);
+        auto colour = findColour (CodeEditorComponent::defaultTextColourId);
+        document.collectGlyphsIntersecting (area, 1, frameArena).draw (g, &colour);
     }
-    g.restoreState();
+}
+
+void mcl::TextEditor::updateTokens (Rectangle<float> area)
+{
+    auto rows = document.getRangeOfRowsIntersecting (area);
+
+	rows.setStart(jmax(0, rows.getStart() - 20));
+
+    // the lines are only tokenised again if they have changed (a minified line can
+    // have millions of characters and this is called for every rendered tile)
+    if (! document.hasDirtyTokens (rows))
+        return;
+
+    auto index = Point<int> (rows.getStart(), 0);
+
+    auto it = TextDocument::Iterator (document, index);
+    auto previous = it.getIndex();
+
+    // this is called for every rendered tile, so the array is reused to avoid the allocations
+    auto& zones = tokenZones;
+    zones.clearQuick();
+
+    Profiler::ScopedTimer st (Profiler::Tokenise);
+
+    while (it.getIndex().x < rows.getEnd() && ! it.isEOF())
+    {
+        auto tokenType = CppTokeniserFunctions::readNextToken (it);
+        zones.add (Selection (previous, it.getIndex()).withStyle (tokenType));
+        previous = it.getIndex();
+    }
+
+	for (auto& z : zones)
+	{
+		if (deactivatesLines.contains(z.tail.x+1))
+			z.token = colourScheme.types.size() - 1;
+	}
+
+    document.clearTokens (rows);
+    document.applyTokens (rows, zones);
+}
+
+void mcl::TextEditor::setUseOpenGLRendering (bool shouldUseOpenGL)
+{
+#if MCL_ENABLE_OPEN_GL
+    if (shouldUseOpenGL == useOpenGLRendering)
+        return;
+
+    useOpenGLRendering = shouldUseOpenGL;
+
+    if (useOpenGLRendering)
+        glRenderer.reset (new GLTextRenderer (*this));
+    else
+        glRenderer = nullptr;
+
+    // the minimap is composited as a texture instead of being redrawn in every frame
+    map.setBufferedToImage (useOpenGLRendering);
+
+    repaint();
+#else
+    ignoreUnused (shouldUseOpenGL);
+    jassertfalse; // enable MCL_ENABLE_OPEN_GL and add the juce_opengl module
+#endif
 }
 
 void mcl::TextEditor::resetProfilingData()
 {
-    accumulatedTimeInPaint = 0.f;
-    numPaintCalls = 0;
+    Profiler::getInstance().clear();
+}
+
+void mcl::TextEditor::exportProfilingData()
+{
+#if JUCE_MODAL_LOOPS_PERMITTED
+    FileChooser fc ("Export profiling data", File::getSpecialLocation (File::userDesktopDirectory).getChildFile ("mcl_profile.json"), "*.json");
+
+    if (fc.browseForFileToSave (true))
+    {
+        auto r = Profiler::getInstance().exportChromeTrace (fc.getResult());
+
+        if (r.failed())
+            AlertWindow::showMessageBoxAsync (AlertWindow::WarningIcon, "Export failed", r.getErrorMessage());
+    }
+#else
+    Profiler::getInstance().exportChromeTrace (File::getSpecialLocation (File::userDesktopDirectory).getChildFile ("mcl_profile.json"));
+#endif
 }
 
 
@@ -56,6 +56,14 @@ public:
     ~TextEditor();
     void setFont (juce::Font font);
     void setText (const juce::String& text);
+
+    /** Loads the file into the CodeDocument. The first lines are shown immediately and the
+        rest of the file is appended in the background (see DocumentLoader). Returns false
+        if the file can't be read.
+    */
+    bool loadFile (const juce::File& file);
+
+    DocumentLoader& getDocumentLoader() { return loader; }
     void translateView (float dx, float dy);
     void scaleView (float scaleFactor, float verticalCenter);
 
@@ -70,6 +78,19 @@ public:
 		resized();
 	}
 
+	/** The default size limit of the undo history. */
+	static constexpr int64 DefaultUndoMemoryBudget = 4 * 1024 * 1024;
+
+	/** Returns the estimated memory usage of this editor, split up into its subsystems. */
+	MemoryUsage getMemoryUsage() const;
+
+	/** Sets the maximum number of bytes that the undo history can use. The oldest steps
+		are removed when the limit is exceeded. */
+	void setUndoMemoryBudget(int64 maxNumBytes);
+
+	/** Renders the text with the GLTextRenderer. This requires MCL_ENABLE_OPEN_GL. */
+	void setUseOpenGLRendering(bool shouldUseOpenGL);
+
     //==========================================================================
     void resized() override;
     void paint (juce::Graphics& g) override;
@@ -84,13 +105,22 @@ public:
 
 	void focusGained(FocusChangeType t) override
 	{
-		caret.startTimer(50);
+		caret.startBlinking();
 	}
 
 	void focusLost(FocusChangeType t) override
 	{
-		caret.stopTimer();
-		caret.repaint();
+		caret.stopBlinking();
+	}
+
+	void visibilityChanged() override
+	{
+		releaseTilesIfHidden();
+	}
+
+	void parentHierarchyChanged() override
+	{
+		releaseTilesIfHidden();
 	}
 
 	Font getFont() const { return document.getFont(); }
@@ -99,12 +129,29 @@ public:
 
 	void codeDocumentTextDeleted(int startIndex, int endIndex) override
 	{
+		// The content was replaced (eg. with CodeDocument::replaceAllContent()), so the
+		// rest of the file that is still loading must not be appended to the new text
+		if (startIndex == 0 && document.getCodeDocument().getNumCharacters() == 0 &&
+			loader.isLoading() && !loader.isChangingDocument())
+		{
+			loader.cancel();
+		}
+
 		updateAfterTextChange();
 	}
 
+	/** The tiles are rendered again when the editor is shown, so they don't need to be kept. */
+	void releaseTilesIfHidden()
+	{
+		if (!isShowing())
+			tiles.clear();
+	}
+
 	void setDeactivatedLines(SparseSet<int> deactivatesLines_)
 	{
 		deactivatesLines = deactivatesLines_;
+		document.invalidateTokens();
+		tiles.clear();
 		repaint();
 	}
 
@@ -489,24 +536,28 @@ private:
 
     //==========================================================================
     bool insert (const juce::String& content);
+    bool performUndo (bool isUndo);
     void updateViewTransform();
     void updateSelections();
     void translateToEnsureCaretIsVisible();
 
     void renderTextUsingGlyphArrangement (juce::Graphics& g);
+
+    /** Draws the text of the rows in the area (in document space). */
+    void renderRows (juce::Graphics& g, juce::Rectangle<float> area);
+
+    /** Tokenises the rows in the area (in document space) for the syntax colouring. */
+    void updateTokens (juce::Rectangle<float> area);
     void resetProfilingData();
+    void exportProfilingData();
     bool enableSyntaxHighlighting = true;
     bool allowCoreGraphics = true;
     bool useOpenGLRendering = false;
     bool drawProfilingInfo = false;
-    float accumulatedTimeInPaint = 0.f;
-    float lastTimeInPaint = 0.f;
-    float lastTokeniserTime = 0.f;
-    int numPaintCalls = 0;
     RenderScheme renderScheme = RenderScheme::usingGlyphArrangement;
 
     //==========================================================================
-    double lastTransactionTime;
+    double lastTransactionTime = 0.0;
     bool tabKeyUsed = true;
     TextDocument document;
 	ScopedPointer<Error> currentError;
@@ -519,6 +570,11 @@ private:
     GutterComponent gutter;
     HighlightComponent highlight;
 	CodeMap map;
+
+#if MCL_ENABLE_OPEN_GL
+	friend class GLTextRenderer;
+	std::unique_ptr<GLTextRenderer> glRenderer;
+#endif
 	FoldMap foldMap;
 	LinebreakDisplay linebreakDisplay;
 	DocTreeView treeview;
@@ -529,7 +585,14 @@ private:
 	int maxLinesToShow = 0;
 	bool lastInsertWasDouble = false;
     juce::Point<float> translation;
-    juce::UndoManager undo;
+    UndoHistory undoHistory;
+    RowTileCache tiles;
+    bool useTileCache = true;
+    DocumentLoader loader;
+
+    FrameArena frameArena;
+    Array<Selection> tokenZones;
+
 	bool showClosures = false;
 	Selection currentClosure[2];
 	TokenTooltipFunction tokenTooltipFunction;
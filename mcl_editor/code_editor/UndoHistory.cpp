@@ -0,0 +1,314 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+juce::int64 mcl::UndoHistory::Entry::getNumBytes() const
+{
+	auto b = (int64)sizeof(Entry);
+
+	if (isCompressed)
+		return b + (int64)compressedData.getSize();
+
+	return b + getDeltaBytes(deltas) + MemoryUsage::getArrayBytes(selectionsBefore) + MemoryUsage::getArrayBytes(selectionsAfter);
+}
+
+juce::int64 mcl::UndoHistory::Entry::getDeltaBytes(const Array<Delta>& deltas)
+{
+	int64 b = 0;
+
+	for (const auto& d : deltas)
+		b += (int64)sizeof(Delta) + MemoryUsage::getStringBytes(d.removed) + MemoryUsage::getStringBytes(d.inserted);
+
+	return b;
+}
+
+bool mcl::UndoHistory::Entry::tryToMerge(const Array<Delta>& newDeltas, const Array<Selection>& newSelectionsAfter)
+{
+	if (isCompressed || newDeltas.size() != deltas.size())
+		return false;
+
+	auto isTyping = [](const Delta& d) { return d.removed.isEmpty() && d.inserted.isNotEmpty() && !d.inserted.containsChar('\n'); };
+	auto isDeleting = [](const Delta& d) { return d.inserted.isEmpty() && d.removed.isNotEmpty() && !d.removed.containsChar('\n'); };
+
+	// The deltas of a multi caret edit are applied from the bottom up, so the position
+	// of delta i after this entry was applied is shifted by the deltas above it (k > i).
+	Array<int> shifts;
+	shifts.insertMultiple(0, 0, deltas.size());
+
+	int shift = 0;
+
+	for (int i = deltas.size() - 1; i >= 0; i--)
+	{
+		shifts.set(i, shift);
+		shift += deltas[i].inserted.length() - deltas[i].removed.length();
+	}
+
+	enum class Type { Typing, Backspace, Delete, numTypes };
+
+	auto getType = [&](int i)
+	{
+		const auto& o = deltas.getReference(i);
+		const auto& n = newDeltas.getReference(i);
+		auto oldPosition = o.offset + shifts[i];
+
+		if (isTyping(n) && o.inserted.isNotEmpty() && !o.inserted.containsChar('\n') &&
+			n.offset == oldPosition + o.inserted.length())
+			return Type::Typing;
+
+		if (isDeleting(n) && isDeleting(o))
+		{
+			if (n.offset + n.removed.length() == oldPosition)
+				return Type::Backspace;
+
+			if (n.offset == oldPosition)
+				return Type::Delete;
+		}
+
+		return Type::numTypes;
+	};
+
+	auto type = getType(0);
+
+	if (type == Type::numTypes)
+		return false;
+
+	for (int i = 1; i < deltas.size(); i++)
+	{
+		if (getType(i) != type)
+			return false;
+	}
+
+	for (int i = 0; i < deltas.size(); i++)
+	{
+		auto& o = deltas.getReference(i);
+		const auto& n = newDeltas.getReference(i);
+
+		switch (type)
+		{
+		case Type::Typing:		o.inserted += n.inserted; break;
+		case Type::Delete:		o.removed += n.removed; break;
+		case Type::Backspace:	o.removed = n.removed + o.removed;
+								o.offset = n.offset - shifts[i];
+								break;
+		default:				jassertfalse; break;
+		}
+	}
+
+	selectionsAfter = newSelectionsAfter;
+	return true;
+}
+
+void mcl::UndoHistory::Entry::compress()
+{
+	if (isCompressed)
+		return;
+
+	MemoryOutputStream mos(compressedData, false);
+
+	{
+		GZIPCompressorOutputStream zipper(mos, 9);
+
+		zipper.writeInt(deltas.size());
+
+		for (const auto& d : deltas)
+		{
+			zipper.writeInt(d.offset);
+			zipper.writeString(d.removed);
+			zipper.writeString(d.inserted);
+		}
+
+		for (auto l : { &selectionsBefore, &selectionsAfter })
+		{
+			zipper.writeInt(l->size());
+
+			for (const auto& s : *l)
+			{
+				zipper.writeInt(s.head.x);
+				zipper.writeInt(s.head.y);
+				zipper.writeInt(s.tail.x);
+				zipper.writeInt(s.tail.y);
+			}
+		}
+	}
+
+	mos.flush();
+	compressedData.setSize(mos.getDataSize());
+
+	deltas.clear();
+	selectionsBefore.clear();
+	selectionsAfter.clear();
+	isCompressed = true;
+}
+
+void mcl::UndoHistory::Entry::decompress()
+{
+	if (!isCompressed)
+		return;
+
+	MemoryInputStream mis(compressedData, false);
+	GZIPDecompressorInputStream unzipper(mis);
+
+	auto numDeltas = unzipper.readInt();
+
+	for (int i = 0; i < numDeltas; i++)
+	{
+		Delta d;
+		d.offset = unzipper.readInt();
+		d.removed = unzipper.readString();
+		d.inserted = unzipper.readString();
+		deltas.add(d);
+	}
+
+	for (auto l : { &selectionsBefore, &selectionsAfter })
+	{
+		auto numSelections = unzipper.readInt();
+
+		for (int i = 0; i < numSelections; i++)
+		{
+			Selection s;
+			s.head.x = unzipper.readInt();
+			s.head.y = unzipper.readInt();
+			s.tail.x = unzipper.readInt();
+			s.tail.y = unzipper.readInt();
+			l->add(s);
+		}
+	}
+
+	compressedData.reset();
+	isCompressed = false;
+}
+
+//==============================================================================
+mcl::UndoHistory::UndoHistory(TextDocument& document_) :
+	document(document_)
+{
+}
+
+mcl::UndoHistory::~UndoHistory()
+{
+}
+
+void mcl::UndoHistory::record(const Array<Delta>& deltas, const Array<Selection>& selectionsBefore,
+							  const Array<Selection>& selectionsAfter, bool canMergeWithPrevious)
+{
+	if (deltas.isEmpty())
+		return;
+
+	// Drop the redo steps
+	for (int i = nextIndex; i < entries.size(); i++)
+		numBytes -= entries[i]->getNumBytes();
+
+	entries.removeRange(nextIndex, entries.size() - nextIndex);
+
+	if (canMergeWithPrevious && nextIndex > 0)
+	{
+		auto last = entries.getLast();
+		auto lastSize = last->getNumBytes();
+
+		// A merged step can't be split up again, so it must not grow beyond the budget
+		if (lastSize + Entry::getDeltaBytes(deltas) <= memoryBudget && last->tryToMerge(deltas, selectionsAfter))
+		{
+			numBytes += last->getNumBytes() - lastSize;
+			removeEntriesOverBudget();
+			return;
+		}
+	}
+
+	auto e = new Entry();
+	e->deltas = deltas;
+	e->selectionsBefore = selectionsBefore;
+	e->selectionsAfter = selectionsAfter;
+
+	entries.add(e);
+	nextIndex = entries.size();
+	numBytes += e->getNumBytes();
+
+	compressOldEntries();
+	removeEntriesOverBudget();
+}
+
+bool mcl::UndoHistory::undo(Array<Selection>& selectionsToRestore)
+{
+	if (!canUndo())
+		return false;
+
+	auto e = entries[--nextIndex];
+
+	auto oldSize = e->getNumBytes();
+	e->decompress();
+	numBytes += e->getNumBytes() - oldSize;
+
+	document.applyDeltas(e->deltas, true);
+	selectionsToRestore = e->selectionsBefore;
+	return true;
+}
+
+bool mcl::UndoHistory::redo(Array<Selection>& selectionsToRestore)
+{
+	if (!canRedo())
+		return false;
+
+	auto e = entries[nextIndex++];
+
+	auto oldSize = e->getNumBytes();
+	e->decompress();
+	numBytes += e->getNumBytes() - oldSize;
+
+	document.applyDeltas(e->deltas, false);
+	selectionsToRestore = e->selectionsAfter;
+	return true;
+}
+
+void mcl::UndoHistory::clear()
+{
+	entries.clear();
+	nextIndex = 0;
+	numBytes = 0;
+}
+
+void mcl::UndoHistory::setMemoryBudget(int64 maxNumBytes)
+{
+	memoryBudget = maxNumBytes;
+	removeEntriesOverBudget();
+}
+
+void mcl::UndoHistory::compressOldEntries()
+{
+	for (int i = nextIndex - NumUncompressedEntries - 1; i >= 0; i--)
+	{
+		auto e = entries[i];
+
+		if (e->isCompressed)
+			break;
+
+		auto oldSize = e->getNumBytes();
+		e->compress();
+		numBytes += e->getNumBytes() - oldSize;
+	}
+}
+
+void mcl::UndoHistory::removeEntriesOverBudget()
+{
+	while (numBytes > memoryBudget && entries.size() > 1 && nextIndex > 1)
+	{
+		numBytes -= entries.getFirst()->getNumBytes();
+		entries.remove(0);
+		nextIndex--;
+	}
+}
+
+
+}
@@ -0,0 +1,115 @@
+/** ============================================================================
+ *
+ * MCL Text Editor JUCE module
+ *
+ * Copyright (C) Jonathan Zrake, Christoph Hart
+ *
+ * You may use, distribute and modify this code under the terms of the GPL3
+ * license.
+ * =============================================================================
+ */
+
+
+#pragma once
+
+namespace mcl
+{
+using namespace juce;
+
+
+//==============================================================================
+/**
+	The undo store of the TextEditor.
+
+	Every undo step is a list of minimal deltas (the character offset, the removed
+	and the inserted text) plus the selections before and after the edit, so the
+	memory usage depends on the size of the edit and not on the line length.
+
+	Consecutive typing (or deleting) at the same carets is merged into a single
+	step, entries that are older than the most recent NumUncompressedEntries are
+	GZIP compressed and the oldest entries are removed when the history exceeds
+	its memory budget.
+*/
+class UndoHistory
+{
+public:
+
+	/** A single replacement in the CodeDocument. The offset is the character index
+		in the document state before this delta was applied.
+	*/
+	struct Delta
+	{
+		int offset = 0;
+		String removed;
+		String inserted;
+	};
+
+	/** The number of recent entries that are kept uncompressed. */
+	static constexpr int NumUncompressedEntries = 32;
+
+	UndoHistory(TextDocument& document);
+	~UndoHistory();
+
+	/** Adds an undo step. The deltas must be in the order they were applied. If
+		canMergeWithPrevious is true and the edit continues the last one (typing or
+		deleting at the same carets), it is appended to the previous step.
+	*/
+	void record(const Array<Delta>& deltas, const Array<Selection>& selectionsBefore,
+				const Array<Selection>& selectionsAfter, bool canMergeWithPrevious);
+
+	/** Reverts the last step and returns the selections that should be restored. */
+	bool undo(Array<Selection>& selectionsToRestore);
+
+	/** Reapplies the last reverted step and returns the selections that should be restored. */
+	bool redo(Array<Selection>& selectionsToRestore);
+
+	bool canUndo() const { return nextIndex > 0; }
+	bool canRedo() const { return nextIndex < entries.size(); }
+
+	void clear();
+
+	/** Sets the maximum number of bytes. The oldest entries will be removed if this is exceeded, but the last step is always kept. */
+	void setMemoryBudget(int64 maxNumBytes);
+
+	int64 getNumBytes() const { return numBytes; }
+
+	int getNumEntries() const { return entries.size(); }
+
+private:
+
+	struct Entry : public MemoryUsage::Tracked<MemoryUsage::UndoHistory>
+	{
+		int64 getNumBytes() const;
+
+		/** Returns the size of the deltas (an upper bound for the growth of a merged entry). */
+		static int64 getDeltaBytes(const Array<Delta>& deltas);
+
+		bool tryToMerge(const Array<Delta>& newDeltas, const Array<Selection>& newSelectionsAfter);
+
+		void compress();
+		void decompress();
+
+		Array<Delta> deltas;
+		Array<Selection> selectionsBefore;
+		Array<Selection> selectionsAfter;
+
+		MemoryBlock compressedData;
+		bool isCompressed = false;
+	};
+
+	void compressOldEntries();
+	void removeEntriesOverBudget();
+
+	TextDocument& document;
+
+	OwnedArray<Entry> entries;
+	int nextIndex = 0;
+
+	int64 numBytes = 0;
+	int64 memoryBudget = 4 * 1024 * 1024;
+
+	JUCE_DECLARE_NON_COPYABLE(UndoHistory);
+};
+
+
+}
@@ -12,13 +12,23 @@
 #include "mcl_editor.h"
  
 #include "code_editor/Helpers.cpp"
+#include "code_editor/LineScanner.cpp"
+#include "code_editor/Profiler.cpp"
+#include "code_editor/Allocators.cpp"
+#include "code_editor/MemoryUsage.cpp"
 #include "code_editor/Selection.cpp"
+#include "code_editor/UndoHistory.cpp"
+#include "code_editor/LineOffsetTable.cpp"
 #include "code_editor/GlyphArrangementArray.cpp"
 #include "code_editor/TextDocument.cpp"
+#include "code_editor/DocumentLoader.cpp"
+#include "code_editor/FileViewer.cpp"
 #include "code_editor/DocTree.cpp"
 #include "code_editor/CodeMap.cpp"
 #include "code_editor/CaretComponent.cpp"
 #include "code_editor/HighlightComponent.cpp"
 #include "code_editor/Gutter.cpp"
 #include "code_editor/Autocomplete.cpp"
-#include "code_editor/TextEditor.cpp"
\ No newline at end of file
+#include "code_editor/RowTileCache.cpp"
+#include "code_editor/TextEditor.cpp"
+#include "code_editor/GLTextRenderer.cpp"
\ No newline at end of file
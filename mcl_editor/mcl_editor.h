@@ -64,32 +64,90 @@ END_JUCE_MODULE_DECLARATION
 
 /** Config: ENABLE_CARET_BLINK
 *
-*	Enable this to make the caret blink (disabled by default)
+*	Enable this to make the caret blink while the editor has the keyboard focus.
 */
 #ifndef ENABLE_CARET_BLINK
 #define ENABLE_CARET_BLINK 1
 #endif
 
+/** Config: MCL_ENABLE_SIMD
+*
+*	Enable this to use the SSE2 / NEON code paths of the text scanning kernels (the minimap
+*	builder and the line scanner). If disabled (or not supported by the target CPU), the
+*	scalar fallback is used. The line scanner uses AVX2 if the module is compiled with it
+*	(eg. -mavx2 or /arch:AVX2).
+*/
+#ifndef MCL_ENABLE_SIMD
+#define MCL_ENABLE_SIMD 1
+#endif
+
+#if MCL_ENABLE_SIMD && JUCE_INTEL && (defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2))
+ #include <emmintrin.h>
+ #define MCL_SIMD_SSE2 1
+#elif MCL_ENABLE_SIMD && JUCE_ARM && (defined (__ARM_NEON__) || defined (__ARM_NEON))
+ #include <arm_neon.h>
+ #define MCL_SIMD_NEON 1
+#endif
+
+#ifndef MCL_SIMD_SSE2
+ #define MCL_SIMD_SSE2 0
+#endif
+
+#ifndef MCL_SIMD_NEON
+ #define MCL_SIMD_NEON 0
+#endif
+
+#define MCL_SIMD_AVAILABLE (MCL_SIMD_SSE2 || MCL_SIMD_NEON)
+
+#if MCL_SIMD_SSE2 && defined (__AVX2__)
+ #include <immintrin.h>
+ #define MCL_SIMD_AVX2 1
+#else
+ #define MCL_SIMD_AVX2 0
+#endif
+
 /** Config: PROFILE_PAINTS
 *
-*	Enable this to show profile statistics for the paint routine performance.
+*	Enable this to start the frame time profiler (mcl::Profiler) on startup.
+*	It can also be enabled at runtime from the context menu of the editor.
 */
 #ifndef PROFILE_PAINTS
 #define PROFILE_PAINTS 0
 #endif
 
 
+/** Config: MCL_TRACK_ALLOCATIONS
+*
+*	Enable this to count the instances and bytes of the heap allocated editor objects
+*	(see mcl::MemoryUsage::getCounter()). Use this to find leaks in long running sessions.
+*/
+#ifndef MCL_TRACK_ALLOCATIONS
+#define MCL_TRACK_ALLOCATIONS 0
+#endif
+
+
 // I'd suggest to split up this big file to multiple files per class and include them here one by one
 #include "code_editor/Helpers.h"
+#include "code_editor/SimdHelpers.h"
+#include "code_editor/LineScanner.h"
+#include "code_editor/Profiler.h"
+#include "code_editor/Allocators.h"
+#include "code_editor/MemoryUsage.h"
 #include "code_editor/Selection.h"
+#include "code_editor/UndoHistory.h"
+#include "code_editor/LineOffsetTable.h"
 #include "code_editor/GlyphArrangementArray.h"
 #include "code_editor/TextDocument.h"
+#include "code_editor/DocumentLoader.h"
+#include "code_editor/FileViewer.h"
 #include "code_editor/DocTree.h"
 #include "code_editor/CodeMap.h"
 #include "code_editor/CaretComponent.h"
 #include "code_editor/HighlightComponent.h"
 #include "code_editor/Gutter.h"
 #include "code_editor/Autocomplete.h"
+#include "code_editor/RowTileCache.h"
+#include "code_editor/GLTextRenderer.h"
 #include "code_editor/TextEditor.hpp"
 
 